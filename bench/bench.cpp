@@ -0,0 +1,479 @@
+// hydro-gen-bench: per-kernel throughput on an offscreen context
+//
+// runs the grid, particle, thermal, heightmap generation and raymarching
+// kernels across map sizes and particle counts, reports cells/s, particles/s,
+// pixels/s and the time per step as JSON or CSV
+#include <chrono>
+#include <cstring>
+#include <string>
+
+#include "erosion.hpp"
+#include "profiler.hpp"
+#include "rendering.hpp"
+#include "state.hpp"
+#include "utils.hpp"
+
+constexpr float BENCH_STEP_TIME = 1.f / 60.f;
+
+struct Options {
+    Vec<u32> sizes      = {256, 512, 1024, 2048, 4096, 8192};
+    Vec<u32> particles  = {65536, 262144, 1048576, 4194304};
+    Vec<std::string> kernels = {
+        "grid", "grid-split", "grid-sparse", "multigrid", "rain", "rain-cached", "particle",
+        "particle-atomic", "thermal", "heightmap", "heightmap-shape", "render"
+    };
+    u32 steps   = 50;
+    u32 warmup  = 5;
+    u32 render_w = 1920;
+    u32 render_h = 1080;
+    // configurations needing more GPU memory are skipped, 0 = no limit
+    size_t max_mem_mb = 0;
+    State::World::Precision precision = State::World::FULL;
+    // particle steps between droplet sorts, 0 = never
+    u32 sort_period = 0;
+    // droplet steps per particle dispatch
+    u32 substeps = 1;
+    bool csv = false;
+    std::string output;
+};
+
+struct Result {
+    std::string kernel;
+    u32 map_size;
+    u32 particles;
+    u32 steps;
+    double wall_ms;
+    double gpu_ms;
+    double throughput;
+    const char* unit;
+};
+
+static bool parse_list(const char* str, Vec<u32>& out) {
+    out.clear();
+    while (*str != '\0') {
+        char* end = nullptr;
+        const auto val = strtoul(str, &end, 10);
+        if (end == str || (*end != ',' && *end != '\0')) {
+            return false;
+        }
+        out.push_back(val);
+        str = *end == ',' ? end + 1 : end;
+    }
+    return !out.empty();
+}
+
+static void print_usage(const char* name) {
+    LOG("usage: {} [options]\n"
+        "  --sizes A,B,..      map sizes (default 256,512,1024,2048,4096,8192)\n"
+        "  --particles A,B,..  particle counts (default 65536,262144,1048576,4194304)\n"
+        "  --kernels A,B,..    grid,grid-split,grid-sparse,multigrid,rain,rain-cached,particle,\n"
+        "                      particle-atomic,thermal,heightmap,heightmap-shape,render\n"
+        "                      (default all)\n"
+        "  --steps N           measured steps per configuration (default 50)\n"
+        "  --warmup N          unmeasured steps before that (default 5)\n"
+        "  --render WxH        raymarching resolution (default 1920x1080)\n"
+        "  --max-mem MB        skip configurations using more GPU memory\n"
+        "  --precision full|reduced  field storage (default full)\n"
+        "  --particle-sort N   sort the droplets by map tile every N steps (default 0, never)\n"
+        "  --substeps N        droplet steps per particle dispatch (default 1)\n"
+        "  --format json|csv   (default json)\n"
+        "  --out PATH          write results to a file instead of stdout",
+        name);
+}
+
+static Opt<Options> parse_args(int argc, char* argv[]) {
+    Options opts;
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* val = (i + 1 < argc) ? argv[++i] : nullptr;
+        if (val == nullptr) {
+            return std::nullopt;
+        }
+        if (!strcmp(arg, "--sizes")) {
+            if (!parse_list(val, opts.sizes)) return std::nullopt;
+        } else if (!strcmp(arg, "--particles")) {
+            if (!parse_list(val, opts.particles)) return std::nullopt;
+        } else if (!strcmp(arg, "--kernels")) {
+            opts.kernels.clear();
+            std::string list = val;
+            size_t start = 0;
+            while (start <= list.size()) {
+                size_t comma = list.find(',', start);
+                if (comma == std::string::npos) {
+                    comma = list.size();
+                }
+                opts.kernels.push_back(list.substr(start, comma - start));
+                start = comma + 1;
+            }
+        } else if (!strcmp(arg, "--steps")) {
+            Vec<u32> v;
+            if (!parse_list(val, v) || v.size() != 1 || v[0] == 0) return std::nullopt;
+            opts.steps = v[0];
+        } else if (!strcmp(arg, "--warmup")) {
+            Vec<u32> v;
+            if (!parse_list(val, v) || v.size() != 1) return std::nullopt;
+            opts.warmup = v[0];
+        } else if (!strcmp(arg, "--render")) {
+            unsigned w, h;
+            if (sscanf(val, "%ux%u", &w, &h) != 2 || w == 0 || h == 0) return std::nullopt;
+            opts.render_w = w;
+            opts.render_h = h;
+        } else if (!strcmp(arg, "--max-mem")) {
+            Vec<u32> v;
+            if (!parse_list(val, v) || v.size() != 1) return std::nullopt;
+            opts.max_mem_mb = v[0];
+        } else if (!strcmp(arg, "--precision")) {
+            if (!strcmp(val, "reduced")) {
+                opts.precision = State::World::REDUCED;
+            } else if (strcmp(val, "full")) {
+                return std::nullopt;
+            }
+        } else if (!strcmp(arg, "--particle-sort")) {
+            Vec<u32> v;
+            if (!parse_list(val, v) || v.size() != 1) return std::nullopt;
+            opts.sort_period = v[0];
+        } else if (!strcmp(arg, "--substeps")) {
+            Vec<u32> v;
+            if (!parse_list(val, v) || v.size() != 1 || v[0] == 0) return std::nullopt;
+            opts.substeps = v[0];
+        } else if (!strcmp(arg, "--format")) {
+            if (!strcmp(val, "csv")) {
+                opts.csv = true;
+            } else if (strcmp(val, "json")) {
+                return std::nullopt;
+            }
+        } else if (!strcmp(arg, "--out")) {
+            opts.output = val;
+        } else {
+            return std::nullopt;
+        }
+    }
+    return opts;
+}
+
+static bool wants(const Options& opts, const char* kernel) {
+    for (const auto& k : opts.kernels) {
+        if (k == kernel) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool fits(const Options& opts, size_t bytes) {
+    return opts.max_mem_mb == 0 || bytes <= opts.max_mem_mb * size_t(1024 * 1024);
+}
+
+// wall time of `steps` calls, the queue is drained before and after
+template <typename F>
+static double time_steps(u32 warmup, u32 steps, F step) {
+    for (u32 i = 0; i < warmup; i++) {
+        step(i);
+    }
+    glFinish();
+    Profiler::collect();
+    Profiler::reset();
+    const auto start = std::chrono::steady_clock::now();
+    for (u32 i = 0; i < steps; i++) {
+        step(warmup + i);
+        Profiler::collect();
+    }
+    glFinish();
+    const auto end = std::chrono::steady_clock::now();
+    Profiler::collect();
+    return std::chrono::duration<double, std::milli>(end - start).count() / steps;
+}
+
+static double gpu_ms(std::initializer_list<u32> passes) {
+    double sum = 0.0;
+    for (auto pass : passes) {
+        sum += Profiler::mean_ms(pass);
+    }
+    return sum;
+}
+
+static double thermal_gpu_ms() {
+    double sum = 0.0;
+    for (u32 pass = Profiler::THERMAL_FLUX; pass < Profiler::SMOOTH; pass++) {
+        sum += Profiler::mean_ms(pass);
+    }
+    return sum;
+}
+
+// throughput uses the wall time: the queue is kept full and drained at the end,
+// and not every driver reports meaningful timer queries for compute (llvmpipe)
+static Result make_result(
+    const char* kernel, u32 size, u32 particles, u32 steps,
+    double wall, double gpu, double work, const char* unit
+) {
+    return Result {
+        .kernel = kernel,
+        .map_size = size,
+        .particles = particles,
+        .steps = steps,
+        .wall_ms = wall,
+        .gpu_ms = gpu,
+        .throughput = work / (wall / 1000.0),
+        .unit = unit
+    };
+}
+
+static void bench_map(const Options& opts, u32 size, Vec<Result>& results) {
+    auto settings = State::setup_settings();
+    defer{ State::delete_settings(settings); };
+    settings.map.data.seed = 1234.f;
+
+    State::World::Map_generator comput_map(State::World::shader_defines(opts.precision));
+    auto world = State::World::gen_textures(size, 0, opts.precision);
+    defer{ State::World::delete_textures(world); };
+    State::World::gen_heightmap(settings, world, comput_map);
+
+    const double cells = double(size) * size;
+    if (wants(opts, "heightmap")) {
+        // noise is expensive, fewer repetitions are plenty
+        const u32 steps = std::max<u32>(1, opts.steps / 10);
+        double wall = time_steps(1, steps, [&](u32) {
+            comput_map.noise_settings.reset();
+            State::World::gen_heightmap(settings, world, comput_map);
+        });
+        results.push_back(make_result("heightmap", size, 0, steps, wall,
+            Profiler::mean_ms(Profiler::HEIGHTMAP) + Profiler::mean_ms(Profiler::HEIGHTMAP_NOISE),
+            cells, "cells/s"));
+    }
+    // a mask or terrace change, the noise stays cached
+    if (wants(opts, "heightmap-shape")) {
+        double wall = time_steps(opts.warmup, opts.steps, [&](u32) {
+            State::World::gen_heightmap(settings, world, comput_map);
+        });
+        results.push_back(make_result("heightmap-shape", size, 0, opts.steps,
+            wall, Profiler::mean_ms(Profiler::HEIGHTMAP), cells, "cells/s"));
+    }
+
+    Uq_ptr<Erosion::Programs> progs(
+        Erosion::setup_shaders(Erosion::Programs::GRID, settings, world, 0)
+    );
+    // fused flux + erosion kernel, the separate passes and the fused kernel on
+    // the tiles near water
+    for (const char* kernel : {"grid", "grid-split", "grid-sparse"}) {
+        if (!wants(opts, kernel)) {
+            continue;
+        }
+        progs->grid->fused = strcmp(kernel, "grid-split") != 0;
+        progs->grid->sparse = !strcmp(kernel, "grid-sparse");
+        double wall = time_steps(opts.warmup, opts.steps, [&](u32 i) {
+            world.time = i * BENCH_STEP_TIME;
+            if (!(i % settings.rain.data.period)) {
+                Erosion::dispatch_grid_rain(*progs, world);
+            }
+            Erosion::dispatch_grid(*progs, world);
+        });
+        double gpu = gpu_ms({
+                Profiler::FLUX, Profiler::EROSION, Profiler::GRID_STEP,
+                Profiler::SEDIMENT, Profiler::SMOOTH, Profiler::TILE_LIST
+            }) + thermal_gpu_ms();
+        results.push_back(make_result(kernel, size, 0, opts.steps, wall, gpu, cells, "cells/s"));
+    }
+    // a whole water cycle per step: restriction, sweeps of every level, prolongation
+    if (wants(opts, "multigrid")) {
+        double wall = time_steps(opts.warmup, opts.steps, [&](u32) {
+            Erosion::dispatch_multigrid(*progs, world);
+        });
+        // the passes are dispatched once per level and sweep, times the mean of a dispatch
+        double gpu = 0.0;
+        for (const auto& pass : progs->grid->multigrid_passes) {
+            gpu += Profiler::mean_ms(pass.profiler_pass);
+        }
+        results.push_back(make_result("multigrid", size, 0, opts.steps, wall, gpu, cells, "cells/s"));
+    }
+    // a rain event per step, the cached patterns are evaluated in the warmup
+    for (const char* kernel : {"rain", "rain-cached"}) {
+        if (!wants(opts, kernel)) {
+            continue;
+        }
+        progs->grid->cached_rain = !strcmp(kernel, "rain-cached");
+        double wall = time_steps(opts.warmup, opts.steps, [&](u32 i) {
+            world.time = i * BENCH_STEP_TIME;
+            Erosion::dispatch_grid_rain(*progs, world);
+        });
+        results.push_back(make_result(kernel, size, 0, opts.steps,
+            wall, Profiler::mean_ms(Profiler::RAIN), cells, "cells/s"));
+    }
+    progs->grid->cached_rain = false;
+    if (wants(opts, "thermal")) {
+        double wall = time_steps(opts.warmup, opts.steps, [&](u32) {
+            Erosion::dispatch_thermal(*progs, world);
+        });
+        results.push_back(make_result("thermal", size, 0, opts.steps,
+            wall, thermal_gpu_ms(), cells, "cells/s"));
+    }
+    if (wants(opts, "render")) {
+        State::Program_state state;
+        Render::Data renderer(opts.render_w, opts.render_h, size, settings, state, world);
+        // looking down at the map from above its centre
+        state.camera.pos = glm::vec3(size / 2.f, State::MAX_HEIGHT * 1.5f, size / 2.f);
+        state.camera.dir = glm::normalize(glm::vec3(0.3f, -1.f, 0.3f));
+        double wall = time_steps(opts.warmup, opts.steps, [&](u32) {
+            renderer.dispatch(world, settings, state.camera);
+        });
+        const double pixels = double(opts.render_w) * opts.render_h;
+        results.push_back(make_result("render", size, 0, opts.steps,
+            wall, Profiler::mean_ms(Profiler::RENDER), pixels, "pixels/s"));
+    }
+}
+
+// droplets with texel locks ("particle") or lock-free deposits ("particle-atomic")
+static State::World::Deposition kernel_deposition(const char* kernel) {
+    return strcmp(kernel, "particle-atomic") ? State::World::LOCKED : State::World::ATOMIC;
+}
+
+static void bench_particles(
+    const Options& opts,
+    const char* kernel,
+    u32 size,
+    u32 count,
+    Vec<Result>& results
+) {
+    const auto deposition = kernel_deposition(kernel);
+    auto settings = State::setup_settings(true, count);
+    defer{ State::delete_settings(settings); };
+    settings.map.data.seed = 1234.f;
+
+    State::World::Map_generator comput_map(State::World::shader_defines(opts.precision));
+    auto world = State::World::gen_textures(size, count, opts.precision, deposition);
+    defer{ State::World::delete_textures(world); };
+    State::World::gen_heightmap(settings, world, comput_map);
+
+    Uq_ptr<Erosion::Programs> progs(
+        Erosion::setup_shaders(Erosion::Programs::PARTICLES, settings, world, count)
+    );
+    progs->particle->substeps = opts.substeps;
+    double wall = time_steps(opts.warmup, opts.steps, [&](u32 i) {
+        world.time = i * BENCH_STEP_TIME;
+        if (opts.sort_period && !(i % opts.sort_period)) {
+            Erosion::sort_particles(*progs, world);
+        }
+        Erosion::dispatch_particle(*progs, world, true);
+    });
+    // droplet throughput only counts the particle kernels, the sort spread
+    // over the steps between two sorts
+    double gpu = gpu_ms({
+        Profiler::PARTICLE_MOVEMENT, Profiler::PARTICLE_EROSION, Profiler::PARTICLE_STEPS,
+        Profiler::DEPOSIT_RESOLVE
+    });
+    if (opts.sort_period) {
+        gpu += gpu_ms({
+            Profiler::PARTICLE_BIN, Profiler::PARTICLE_SCAN, Profiler::PARTICLE_SCATTER
+        }) / opts.sort_period;
+    }
+    // every dispatch moves each droplet `substeps` times
+    const double droplet_steps = double(count) * opts.substeps;
+    results.push_back(make_result(kernel, size, count, opts.steps, wall, gpu, droplet_steps, "particles/s"));
+}
+
+static std::string format_results(const Options& opts, const Vec<Result>& results) {
+    std::string out;
+    if (opts.csv) {
+        out += "kernel,map_size,particles,steps,wall_ms_per_step,gpu_ms_per_step,throughput,unit\n";
+        for (const auto& r : results) {
+            out += fmt::format("{},{},{},{},{:.4f},{:.4f},{:.6e},{}\n",
+                r.kernel, r.map_size, r.particles, r.steps,
+                r.wall_ms, r.gpu_ms, r.throughput, r.unit);
+        }
+        return out;
+    }
+    out += fmt::format(
+        "{{\n  \"renderer\": \"{}\",\n  \"version\": \"{}\",\n  \"precision\": \"{}\",\n"
+        "  \"results\": [\n",
+        (const char*)glGetString(GL_RENDERER),
+        (const char*)glGetString(GL_VERSION),
+        opts.precision == State::World::REDUCED ? "reduced" : "full");
+    for (size_t i = 0; i < results.size(); i++) {
+        const auto& r = results[i];
+        out += fmt::format(
+            "    {{\"kernel\": \"{}\", \"map_size\": {}, \"particles\": {}, \"steps\": {}, "
+            "\"wall_ms_per_step\": {:.4f}, \"gpu_ms_per_step\": {:.4f}, "
+            "\"throughput\": {:.6e}, \"unit\": \"{}\"}}{}\n",
+            r.kernel, r.map_size, r.particles, r.steps,
+            r.wall_ms, r.gpu_ms, r.throughput, r.unit,
+            i + 1 < results.size() ? "," : "");
+    }
+    out += "  ]\n}\n";
+    return out;
+}
+
+int main(int argc, char* argv[]) {
+    const auto opts = parse_args(argc, argv);
+    if (!opts) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    bool gl_error = false;
+    Uq_ptr<Headless_context, decltype(&destroy_headless)> context(
+        init_headless(&gl_error),
+        destroy_headless
+    );
+    if (context == nullptr) {
+        return EXIT_FAILURE;
+    }
+    defer { Profiler::destroy(); };
+
+    Vec<Result> results;
+    for (auto size : opts->sizes) {
+        if (size % WRKGRP_SIZE_X || size % WRKGRP_SIZE_Y) {
+            LOG_ERR("Map size {} is not a multiple of the workgroup size, skipping.", size);
+            continue;
+        }
+        if (!fits(*opts, State::World::texture_bytes(size, 0, opts->precision))) {
+            LOG_ERR("Map size {} exceeds the memory limit, skipping.", size);
+            continue;
+        }
+        LOG_DBG("Benchmarking map size {}...", size);
+        bench_map(*opts, size, results);
+        if (gl_error) {
+            LOG_ERR("OpenGL error, aborting the benchmark.");
+            return EXIT_FAILURE;
+        }
+
+        if (!wants(*opts, "particle") && !wants(*opts, "particle-atomic")) {
+            continue;
+        }
+        for (auto count : opts->particles) {
+            if (count % (WRKGRP_SIZE_X * WRKGRP_SIZE_Y)) {
+                LOG_ERR("Particle count {} is not a multiple of the workgroup size, skipping.", count);
+                continue;
+            }
+            for (const char* kernel : {"particle", "particle-atomic"}) {
+                if (!wants(*opts, kernel)) {
+                    continue;
+                }
+                const auto bytes = State::World::texture_bytes(
+                    size, count, opts->precision, kernel_deposition(kernel)
+                );
+                if (!fits(*opts, bytes)) {
+                    LOG_ERR("{} particles on map size {} exceed the memory limit, skipping.", count, size);
+                    continue;
+                }
+                LOG_DBG("Benchmarking {} particles on map size {} ({})...", count, size, kernel);
+                bench_particles(*opts, kernel, size, count, results);
+            }
+        }
+        if (gl_error) {
+            LOG_ERR("OpenGL error, aborting the benchmark.");
+            return EXIT_FAILURE;
+        }
+    }
+
+    const auto out = format_results(*opts, results);
+    if (opts->output.empty()) {
+        fmt::print(stdout, "{}", out);
+        return EXIT_SUCCESS;
+    }
+    FILE* file = fopen(opts->output.c_str(), "wb");
+    if (!file) {
+        LOG_ERR("FAILED TO WRITE TO FILE: {}", opts->output);
+        return EXIT_FAILURE;
+    }
+    defer { fclose(file); };
+    fwrite(out.data(), out.size(), 1, file);
+    return EXIT_SUCCESS;
+}
@@ -12,10 +12,65 @@
 #define BIND_UNIFORM_EROSION 1
 #define BIND_UNIFORM_MAP_SETTINGS 2
 #define BIND_UNIFORM_RAIN_SETTINGS 3
-#define BIND_PARTICLE_BUFFER 4
+// droplet streams, see particle_streams.glsl
+#define BIND_PARTICLE_MOTION 4
+#define BIND_STEP_BUFFER 5
+// the erosion uniform buffer viewed as a storage buffer, adaptive time step only
+#define BIND_EROSION_STORAGE 6
+// sparse grid erosion, see tiles.glsl
+#define BIND_TILE_STATE 7
+#define BIND_TILE_LIST 8
+// droplet sorting, see particle_bins.glsl
+#define BIND_SCRATCH_MOTION 9
+#define BIND_PARTICLE_BINS 10
+// live droplets, see particle_live.glsl
+#define BIND_PARTICLE_LIVE 11
+#define BIND_PARTICLE_STATE 12
+#define BIND_PARTICLE_SEDIMENT 13
+#define BIND_PARTICLE_KILL 14
+#define BIND_SCRATCH_STATE 15
+#define BIND_SCRATCH_SEDIMENT 16
+#define BIND_SCRATCH_KILL 17
+
+// lock-free particle deposition: fixed point deltas of every sediment layer,
+// the water and the 2 momentum components, see deposit_resolve.glsl
+#define DEPOSIT_LAYERS (SED_LAYERS + 3)
+
+// cached rain: noise patterns evaluated once, see rain_pattern.glsl
+#define RAIN_PATTERNS 4
 
-#if defined(GL_core_profile) 
+#if defined(GL_core_profile)
     const float L = 1.0;
+
+    // the erosion kernels are compiled for one map size, see
+    // State::World::kernel_defines, anything else falls back to the size of a
+    // dispatch over the whole map
+    #ifndef MAP_SIZE
+    #define MAP_SIZE (gl_WorkGroupSize.x * gl_NumWorkGroups.x)
+    #endif
+
+    // image formats of the hydraulic fields, the storage precision of
+    // State::World::gen_textures defines its own, heights are always rgba32f
+    #ifndef FLUX_FORMAT
+    #define FLUX_FORMAT rgba32f
+    #endif
+    #ifndef VEL_FORMAT
+    #define VEL_FORMAT rgba32f
+    #endif
+    #ifndef SED_FORMAT
+    #define SED_FORMAT rgba32f
+    #endif
+    #ifndef THFLUX_FORMAT
+    #define THFLUX_FORMAT rgba32f
+    #endif
+
+    // units per 1.0 of the fixed point deposits: a droplet moves well under a
+    // unit of terrain, 1e-5 of its volume in water and at most its velocity
+    // (capped at 1) in momentum, each leaves room for thousands of droplets on
+    // a texel within a step
+    const float DEPOSIT_SCALE[DEPOSIT_LAYERS] = float[](
+        1048576.0, 1048576.0, 1073741824.0, 65536.0, 65536.0
+    );
 #endif
 
 #if defined(GL_core_profile)
@@ -57,6 +112,22 @@ struct Erosion_data {
     GL(FLOAT) min_volume;
     GL(FLOAT) min_velocity;
     GL(UINT)  ttl; // time to live
+
+    // adaptive time step of grid erosion: d_t = courant * L / fastest wave,
+    // clamped to [d_t_min, d_t_max]
+    GL(FLOAT) courant;
+    GL(FLOAT) d_t_min;
+    GL(FLOAT) d_t_max;
+};
+
+// written by cfl_step.glsl, persistently mapped on the CPU
+struct Step_data {
+    // float bits of the fastest wave speed, atomicMax orders positive floats
+    GL(UINT)    max_speed;
+    GL(FLOAT)   d_t;
+    // simulated time advanced by the adaptive steps
+    GL(FLOAT)   time;
+    GL(UINT)    updates;
 };
 
 struct Rain_data {
@@ -98,6 +169,8 @@ struct Map_settings_data {
     GL(FLOAT) terrace_scale;
 };
 
+// a whole droplet, the CPU backend stores them like this, the shaders load
+// one from the streams below
 struct Particle {
     GL(FLOAT)   sc;
     GL(INT)     iters;
@@ -109,4 +182,18 @@ struct Particle {
     // sediment layers
     GL(BOOL)    to_kill;
 };
+
+// droplets of the GPU, one element per droplet in every stream: motion,
+// state, the vec2 sediment of its layers and a bit of the uint kill mask
+struct Particle_motion {
+    GL(VEC2)    position;
+    GL(VEC2)    velocity;
+};
+
+struct Particle_state {
+    GL(FLOAT)   volume;
+    // sediment capacity at a point
+    GL(FLOAT)   sc;
+    GL(INT)     iters;
+};
 #endif // HYDR_GL_BINDINGS_HPP
@@ -0,0 +1,51 @@
+#version 460
+
+#include <bindings>
+#line 5
+
+// fastest wave on the map for the adaptive time step: flow speed plus the
+// shallow water wave celerity sqrt(g * h), reduced in shared memory, one
+// atomicMax per workgroup, cfl_step.glsl turns the result into d_t
+layout (local_size_x = WRKGRP_SIZE_X, local_size_y = WRKGRP_SIZE_Y) in;
+
+layout (binding = 0) uniform sampler2D heightmap;
+// vec3((u, v), average water height of the last step)
+layout (binding = 1) uniform sampler2D velocitymap;
+
+layout (std140, binding = BIND_UNIFORM_EROSION) uniform erosion_data {
+    Erosion_data set;
+};
+
+layout (std430, binding = BIND_STEP_BUFFER) buffer step_buffer {
+    Step_data step;
+};
+
+// velocities of water films come from dividing by a vanishing depth: a cell
+// that drains completely reads about L / d_t, which would only ever shrink the
+// step, the flux scaling already keeps those stable, vel.z is twice the depth
+const float MIN_FLOW_DEPTH = 1e-2;
+
+#define GROUP_SIZE (WRKGRP_SIZE_X * WRKGRP_SIZE_Y)
+shared float speeds[GROUP_SIZE];
+
+void main() {
+    ivec2 pos = ivec2(gl_GlobalInvocationID.xy);
+    float water = max(0, texelFetch(heightmap, pos, 0).b);
+    vec3 vel = texelFetch(velocitymap, pos, 0).xyz;
+    float flow = vel.z < MIN_FLOW_DEPTH ? 0 : length(vel.xy);
+    speeds[gl_LocalInvocationIndex] = flow + sqrt(set.G * water);
+    barrier();
+    for (uint stride = GROUP_SIZE / 2; stride > 0; stride /= 2) {
+        if (gl_LocalInvocationIndex < stride) {
+            // NaN wins, cfl_step.glsl falls back to d_t_min
+            float other = speeds[gl_LocalInvocationIndex + stride];
+            if (!(other <= speeds[gl_LocalInvocationIndex])) {
+                speeds[gl_LocalInvocationIndex] = other;
+            }
+        }
+        barrier();
+    }
+    if (gl_LocalInvocationIndex == 0) {
+        atomicMax(step.max_speed, floatBitsToUint(abs(speeds[0])));
+    }
+}
@@ -0,0 +1,39 @@
+#version 460
+
+#include <bindings>
+#line 5
+
+// turns the fastest wave of cfl_reduce.glsl into the time step of the next
+// `period` steps and writes it straight into the erosion uniform buffer, the
+// CPU never has to read it back
+layout (local_size_x = 1) in;
+
+layout (std430, binding = BIND_EROSION_STORAGE) buffer erosion_storage {
+    Erosion_data set;
+};
+
+layout (std430, binding = BIND_STEP_BUFFER) buffer step_buffer {
+    Step_data step;
+};
+
+// steps until the next update, and the steps the last d_t was counted for
+// that it doesn't run when it's replaced early
+uniform uint period;
+uniform uint refund;
+
+void main() {
+    float max_speed = uintBitsToFloat(step.max_speed);
+    float d_t = set.courant * L / max_speed;
+    // a dry map gives inf and ends up at d_t_max, a NaN somewhere on the map
+    // gives the smallest step
+    if (!(d_t >= set.d_t_min)) {
+        d_t = set.d_t_min;
+    }
+    d_t = min(d_t, set.d_t_max);
+
+    set.d_t = d_t;
+    step.time += float(period) * d_t - float(refund) * step.d_t;
+    step.d_t = d_t;
+    step.updates += 1;
+    step.max_speed = 0;
+}
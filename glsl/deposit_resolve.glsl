@@ -0,0 +1,35 @@
+#version 460
+
+#include <bindings>
+#line 5
+
+// applies the fixed point deposits of particle_erosion.glsl (ATOMIC_DEPOSITION)
+// to the heightmap and the momentmap and clears them for the next step
+layout (local_size_x = WRKGRP_SIZE_X, local_size_y = WRKGRP_SIZE_Y) in;
+
+layout (binding = 0, r32i) uniform iimage2D deposits[DEPOSIT_LAYERS];
+layout (binding = DEPOSIT_LAYERS, rgba32f) uniform image2D heightmap;
+layout (binding = DEPOSIT_LAYERS + 1, VEL_FORMAT) uniform image2D momentmap;
+
+float take_deposit(ivec2 pos, uint layer) {
+    int value = imageLoad(deposits[layer], pos).r;
+    imageStore(deposits[layer], pos, ivec4(0));
+    return float(value) / DEPOSIT_SCALE[layer];
+}
+
+void main() {
+    ivec2 pos = ivec2(gl_GlobalInvocationID.xy);
+    vec4 terr = imageLoad(heightmap, pos);
+    // droplets on the same texel each erode the terrain of the start of the
+    // step, together they can dig below the bottom of a layer
+    for (uint i = 0; i < SED_LAYERS + 1; i++) {
+        terr[i] = max(0.0, terr[i] + take_deposit(pos, i));
+    }
+    terr.w = terr.r + terr.g + terr.b;
+    imageStore(heightmap, pos, terr);
+
+    vec4 momentm = imageLoad(momentmap, pos);
+    momentm.z += take_deposit(pos, SED_LAYERS + 1);
+    momentm.w += take_deposit(pos, SED_LAYERS + 2);
+    imageStore(momentmap, pos, momentm);
+}
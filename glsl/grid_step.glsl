@@ -0,0 +1,238 @@
+#version 460
+
+#include <bindings>
+#include <tiles>
+#line 5
+
+// hydro_flux.glsl and hydro_erosion.glsl in one dispatch, erosion of a cell only
+// needs its own new velocity and the rock/dirt of its neighbours which the flux
+// update leaves alone, sediment transport stays a separate pass since the
+// back-traced position can be any distance away
+layout (local_size_x = WRKGRP_SIZE_X, local_size_y = WRKGRP_SIZE_Y) in;
+
+// (dirt height, rock height, water height, total height)
+layout (binding = 0) uniform sampler2D heightmap;
+layout (binding = 1, rgba32f)
+	uniform writeonly image2D out_heightmap;
+
+// (fL, fR, fT, fB) left, right, top, bottom
+layout (binding = 2) uniform sampler2D fluxmap;
+layout (binding = 3, FLUX_FORMAT)
+	uniform writeonly image2D out_fluxmap;
+
+// vec3((u, v), average water height), only read and written at the own cell
+layout (binding = 4, VEL_FORMAT)
+	uniform image2D velocitymap;
+
+layout (binding = 6) uniform sampler2D sedimap;
+layout (binding = 7, SED_FORMAT)
+	uniform writeonly image2D out_sedimap;
+
+layout (std140, binding = BIND_UNIFORM_EROSION) uniform erosion_data {
+    Erosion_data set;
+};
+
+// cross-section area of a pipe
+const float A = 1.0;
+
+// heightmap and fluxmap of the workgroup plus a one cell border
+#define TILE_X (WRKGRP_SIZE_X + 2)
+#define TILE_Y (WRKGRP_SIZE_Y + 2)
+shared vec4 height_tile[TILE_Y][TILE_X];
+shared vec4 flux_tile[TILE_Y][TILE_X];
+
+// any cell of the workgroup still has water, inflow or sediment
+shared bool live_tile;
+
+void load_tiles() {
+    ivec2 size = ivec2(MAP_SIZE);
+    ivec2 origin = ivec2(tile_id() * gl_WorkGroupSize.xy) - ivec2(1);
+    if (gl_LocalInvocationIndex == 0) {
+        live_tile = false;
+    }
+    for (uint i = gl_LocalInvocationIndex; i < TILE_X * TILE_Y; i += WRKGRP_SIZE_X * WRKGRP_SIZE_Y) {
+        ivec2 t = ivec2(i % TILE_X, i / TILE_X);
+        ivec2 pos = origin + t;
+        if (pos.x < 0 || pos.y < 0 || pos.x >= size.x || pos.y >= size.y) {
+            // water can't flow out of the map, the terrain normal sees no terrain
+            height_tile[t.y][t.x] = vec4(0, 0, 0, 999999999999.0);
+            flux_tile[t.y][t.x] = vec4(0);
+        } else {
+            height_tile[t.y][t.x] = texelFetch(heightmap, pos, 0);
+            flux_tile[t.y][t.x] = texelFetch(fluxmap, pos, 0);
+        }
+    }
+    barrier();
+}
+
+vec4 get_height(ivec2 offset) {
+    ivec2 t = ivec2(gl_LocalInvocationID.xy) + ivec2(1) + offset;
+    return height_tile[t.y][t.x];
+}
+
+vec4 get_flux(ivec2 offset) {
+    ivec2 t = ivec2(gl_LocalInvocationID.xy) + ivec2(1) + offset;
+    return flux_tile[t.y][t.x];
+}
+
+vec3 get_terr_normal() {
+    vec2 r = get_height(ivec2( 1, 0)).rg;
+    vec2 l = get_height(ivec2(-1, 0)).rg;
+    vec2 b = get_height(ivec2( 0,-1)).rg;
+    vec2 t = get_height(ivec2( 0, 1)).rg;
+    float dx = (
+        r.r + r.g - l.r - l.g
+    );
+    float dz = (
+        t.r + t.g - b.r - b.g
+    );
+    return normalize(cross(vec3(2.0 * L, dx, 0), vec3(0, dz, 2.0 * L)));
+}
+
+void main() {
+    load_tiles();
+    ivec2 pos = tile_pos();
+    ivec2 size = ivec2(MAP_SIZE);
+
+    // ----------------------------- flux ------------------------------
+    vec4 flux     = get_flux(ivec2(0));
+    vec4 out_flux = flux;
+    vec4 vel      = imageLoad(velocitymap, pos);
+
+    // water height
+    vec4 terrain = get_height(ivec2(0));
+    float d1 = terrain.b;
+
+    // total height difference
+    vec4 d_height;
+    d_height.x = terrain.w - get_height(ivec2(-1, 0)).w; // left
+    d_height.y = terrain.w - get_height(ivec2( 1, 0)).w; // right
+    d_height.z = terrain.w - get_height(ivec2( 0, 1)).w; // top
+    d_height.w = terrain.w - get_height(ivec2( 0,-1)).w; // bottom
+
+    vec4 in_flux;
+    in_flux.x = get_flux(ivec2(-1, 0)).y; // from left
+    in_flux.y = get_flux(ivec2( 1, 0)).x; // from right
+    in_flux.z = get_flux(ivec2( 0, 1)).w; // from top
+    in_flux.w = get_flux(ivec2( 0,-1)).z; // from bottom
+
+    out_flux.x =
+        max(0, set.ENERGY_KEPT * out_flux.x + set.d_t * A * (set.G * d_height.x) / L);
+    out_flux.y =
+        max(0, set.ENERGY_KEPT * out_flux.y + set.d_t * A * (set.G * d_height.y) / L);
+    out_flux.z =
+        max(0, set.ENERGY_KEPT * out_flux.z + set.d_t * A * (set.G * d_height.z) / L);
+    out_flux.w =
+        max(0, set.ENERGY_KEPT * out_flux.w + set.d_t * A * (set.G * d_height.w) / L);
+
+    // boundary checking
+    if (pos.x <= 0) {
+        out_flux.x = 0;
+    } else if (pos.x >= size.x - 1) {
+        out_flux.y = 0;
+    }
+    if (pos.y <= 0) {
+        out_flux.w = 0;
+    } else if (pos.y >= size.y - 1) {
+        out_flux.z = 0;
+    }
+
+    float sum_in_flux = in_flux.x + in_flux.y + in_flux.z + in_flux.w;
+    vec4 sediment = texelFetch(sedimap, pos, 0);
+    float sum_out_flux = out_flux.x + out_flux.y + out_flux.z + out_flux.w;
+
+    // scaling factor
+    float K = min(1.0, (terrain.b * L * L) / (sum_out_flux * set.d_t));
+    out_flux *= K;
+    sum_out_flux *= K;
+    float d_volume = set.d_t * (sum_in_flux - sum_out_flux);
+    float d2 = max(0, d1 + (d_volume / (L * L)));
+
+    terrain.b = d2;
+
+    // average water height
+    vel.z = (d1 + d2);
+
+    if (vel.z > 0) {
+        vel.x = (
+            get_flux(ivec2(-1, 0)).y -
+            flux.x +
+            flux.y -
+            get_flux(ivec2(1, 0)).x
+        ) / (L * vel.z);
+        vel.y = (
+            get_flux(ivec2(0, -1)).z -
+            flux.w +
+            flux.z -
+            get_flux(ivec2(0, 1)).w
+        ) / (L * vel.z);
+    } else {
+        vel.xy = vec2(0, 0);
+    }
+
+    // ---------------------------- erosion ----------------------------
+    float dd = vel.z;
+    float ero_vel = length(vel.xy);
+    if (dd < 1e-3) {
+        dd = max(5e-4, dd);
+        ero_vel = mix(length(vel.xy), 0, smoothstep(1e-3, 5e-4, dd));
+    } else {
+        ero_vel = length(vel.xy);
+    }
+
+    // how much sediment from other layers is already in the water
+    float cap = 0.0;
+    vec3 norm = get_terr_normal();
+    float sin_a = length(abs(sqrt(1.0 - norm.y * norm.y)));
+    for (int i = (SED_LAYERS - 1); i >= 0; i--) {
+        // sediment capacity constant for a layer
+        float Kls = set.d_t * set.Ks[i];
+        float Kld = set.d_t * set.Kd[i];
+        // sediment transport capacity
+        float c = max(0, set.Kc * max(0.02, sin_a) * ero_vel - cap);
+
+        // dissolve sediment
+        if (c > sediment[i]) {
+            float old_terr = terrain[i];
+            terrain[i] -= Kls * (c - sediment[i]);
+            sediment[i] += Kls * (c - sediment[i]);
+            if (terrain[i] < 0) {
+                sediment[i] += terrain[i];
+                terrain[i] = 0;
+                cap += old_terr;
+            } else {
+                break;
+            }
+        }
+        // deposit sediment
+        else {
+            terrain[i] += Kld * (sediment[i] - c);
+            sediment[i] -= Kld * (sediment[i] - c);
+        }
+    }
+    for (uint i = 0; i < (SED_LAYERS - 1); i++) {
+        float conv = sediment[i] * set.Kconv * set.d_t;
+        sediment[i + 1] += conv;
+        sediment[i] -= conv;
+    }
+    terrain.w = terrain.r + terrain.g + terrain.b;
+
+    imageStore(out_fluxmap, pos, out_flux);
+    imageStore(velocitymap, pos, vel);
+    imageStore(out_sedimap, pos, sediment);
+    imageStore(out_heightmap, pos, terrain);
+
+    // kept up in dense runs too, sparse ones can start at any step. A cell
+    // without water, flux or sediment comes out of the step unchanged, a
+    // tile of them can be skipped without changing the result
+    bool live = d1 > 0 || d2 > 0 || sum_in_flux > 0 || sum_out_flux > 0 ||
+        sediment.r != 0 || sediment.g != 0;
+    if (live) {
+        live_tile = true;
+    }
+    barrier();
+    if (gl_LocalInvocationIndex == 0) {
+        uint index = tile_index(tile_id(), size.x);
+        tile_state[index] = live_tile ? 0 : min(tile_state[index] + 1, TILE_QUIET);
+    }
+}
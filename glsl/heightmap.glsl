@@ -8,12 +8,15 @@ layout (local_size_x = WRKGRP_SIZE_X, local_size_y = WRKGRP_SIZE_Y) in;
 
 // (dirt, rock, water, total)
 layout (rgba32f, binding = 0) uniform writeonly image2D dest_heightmap;
-layout (rgba32f, binding = 1) uniform writeonly image2D dest_vel;
-layout (rgba32f, binding = 2) uniform writeonly image2D dest_flux;
-layout (rgba32f, binding = 3) uniform writeonly image2D dest_sediment;
+layout (VEL_FORMAT, binding = 1) uniform writeonly image2D dest_vel;
+layout (FLUX_FORMAT, binding = 2) uniform writeonly image2D dest_flux;
+layout (SED_FORMAT, binding = 3) uniform writeonly image2D dest_sediment;
 
-layout(std430, binding = BIND_PARTICLE_BUFFER) buffer ParticleBuffer {
-    Particle particles[];
+// the cached noise terms of heightmap_noise.glsl, everything below only shapes them
+layout (rg32f, binding = 4) uniform readonly image2D noise;
+
+layout(std430, binding = BIND_PARTICLE_STATE) buffer ParticleState {
+    Particle_state particle_state[];
 };
 
 layout (std140, binding = BIND_UNIFORM_MAP_SETTINGS)
@@ -21,6 +24,9 @@ uniform map_settings {
     Map_settings_data cfg;
 };
 
+// droplets of particle erosion, every invocation resets every (map texels)th one
+uniform uint particle_count;
+
 // Function to generate a random float in the range [0, 1]
 float rand(vec2 co) {
     return fract(sin(dot(co.xy, vec2(12.9898, 78.233))) * 43758.5453);
@@ -52,54 +58,16 @@ float distort(float x, float y) {
 void main() {
     ivec2 store_pos = ivec2(gl_GlobalInvocationID.xy);
     vec2 uv = gl_GlobalInvocationID.xy / vec2(imageSize(dest_heightmap).xy);
-    gln_tFBMOpts opts = gln_tFBMOpts(
-        cfg.seed,
-        cfg.persistance,
-        cfg.lacunarity,
-        cfg.scale,
-        1.0,
-        cfg.octaves,
-        false,
-        false
-    );
-    vec2 dist = vec2(1, 1);
-    if (cfg.domain_warp != 0) {
-        dist = vec2(
-            perlfbm(vec2(store_pos.x + 2.3, store_pos.y + 2.9), opts),
-            perlfbm(vec2(store_pos.x - 3.1, store_pos.y - 4.3), opts)
-        );
-        if (cfg.domain_warp == 2) {
-            dist = vec2(
-                perlfbm(vec2(store_pos.x + cfg.domain_warp_scale* dist.x - 5.7, store_pos.y + cfg.domain_warp_scale*dist.y + 27.9), opts),
-                perlfbm(vec2(store_pos.x + cfg.domain_warp_scale* dist.x + 11.5, store_pos.y + cfg.domain_warp_scale*dist.y - 23.7), opts)
-            );
-        }
-    }
-    float val = 0.0;
-    if (cfg.fake_erosion != 0) {
-        val = erosion_perlfbm(vec2(store_pos) + cfg.domain_warp_scale * dist, opts);
-    } else {
-        val = (erosion_perlfbm(vec2(store_pos) + cfg.domain_warp_scale * dist, opts));
-    }
+    vec2 noise_val = imageLoad(noise, store_pos).xy;
+    float val = noise_val.x;
 
     float height_multiplier = cfg.height_mult;
+    // the uplift itself is part of the noise
     if (cfg.uplift != 0) {
-        gln_tFBMOpts up_opts = gln_tFBMOpts(
-            cfg.seed,
-            cfg.persistance,
-            cfg.lacunarity,
-            cfg.scale / cfg.uplift_scale,
-            1.0,
-            cfg.octaves,
-            true,
-            true
-        );
-        float up = gln_sfbm(vec2(store_pos.x - 7.3, store_pos.y + 19.9), up_opts);
         if (cfg.mask_exp != 0) {
             height_multiplier += 2.5;
         }
         height_multiplier += 1.0;
-        val *= up;
     }
     if (cfg.mask_round != 0) {
         if (cfg.mask_exp != 0) {
@@ -131,9 +99,7 @@ void main() {
     }
 
     float rock_val = min(cfg.max_height, val * cfg.max_height * height_multiplier);
-    float dirt_val = 2.0;
-    dirt_val = perlfbm(store_pos + vec2(13.7, 27.1), opts) + 1.5;
-    dirt_val *= cfg.max_dirt;
+    float dirt_val = (noise_val.y + 1.5) * cfg.max_dirt;
 
     vec4 terrain = vec4(
         rock_val,
@@ -144,13 +110,11 @@ void main() {
     // water height
     //terrain.b = max(0.0, 10.0 - (terrain.r + terrain.g));
     terrain.w = terrain.r + terrain.g + terrain.b;
-#if defined(PARTICLE_COUNT)
-    if (gl_GlobalInvocationID.xy == vec2(0, 0)) {
-        for (uint i = 0; i < PARTICLE_COUNT; i++) {
-            particles[i].iters = 0;
-        }
+    uint texels = gl_NumWorkGroups.x * gl_NumWorkGroups.y * WRKGRP_SIZE_X * WRKGRP_SIZE_Y;
+    uint texel = store_pos.y * gl_NumWorkGroups.x * WRKGRP_SIZE_X + store_pos.x;
+    for (uint i = texel; i < particle_count; i += texels) {
+        particle_state[i].iters = 0;
     }
-#endif
     imageStore(dest_heightmap, store_pos, terrain);
     imageStore(dest_vel, store_pos, vec4(0));
     imageStore(dest_flux, store_pos, vec4(0));
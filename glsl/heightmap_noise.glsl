@@ -0,0 +1,64 @@
+#version 460
+
+#include <bindings>
+#include <simplex_noise>
+#line 6
+
+// the expensive noise terms of heightmap.glsl: the domain warped terrain noise
+// (times the uplift) and the dirt noise, only redone when a setting they depend
+// on changes, see State::World::Map_generator
+layout (local_size_x = WRKGRP_SIZE_X, local_size_y = WRKGRP_SIZE_Y) in;
+
+// (terrain, dirt)
+layout (rg32f, binding = 0) uniform writeonly image2D dest_noise;
+
+layout (std140, binding = BIND_UNIFORM_MAP_SETTINGS)
+uniform map_settings {
+    Map_settings_data cfg;
+};
+
+void main() {
+    ivec2 store_pos = ivec2(gl_GlobalInvocationID.xy);
+    gln_tFBMOpts opts = gln_tFBMOpts(
+        cfg.seed,
+        cfg.persistance,
+        cfg.lacunarity,
+        cfg.scale,
+        1.0,
+        cfg.octaves,
+        false,
+        false
+    );
+    vec2 dist = vec2(1, 1);
+    if (cfg.domain_warp != 0) {
+        dist = vec2(
+            perlfbm(vec2(store_pos.x + 2.3, store_pos.y + 2.9), opts),
+            perlfbm(vec2(store_pos.x - 3.1, store_pos.y - 4.3), opts)
+        );
+        if (cfg.domain_warp == 2) {
+            dist = vec2(
+                perlfbm(vec2(store_pos.x + cfg.domain_warp_scale* dist.x - 5.7, store_pos.y + cfg.domain_warp_scale*dist.y + 27.9), opts),
+                perlfbm(vec2(store_pos.x + cfg.domain_warp_scale* dist.x + 11.5, store_pos.y + cfg.domain_warp_scale*dist.y - 23.7), opts)
+            );
+        }
+    }
+    float val = erosion_perlfbm(vec2(store_pos) + cfg.domain_warp_scale * dist, opts);
+
+    if (cfg.uplift != 0) {
+        gln_tFBMOpts up_opts = gln_tFBMOpts(
+            cfg.seed,
+            cfg.persistance,
+            cfg.lacunarity,
+            cfg.scale / cfg.uplift_scale,
+            1.0,
+            cfg.octaves,
+            true,
+            true
+        );
+        float up = gln_sfbm(vec2(store_pos.x - 7.3, store_pos.y + 19.9), up_opts);
+        val *= up;
+    }
+
+    float dirt = perlfbm(store_pos + vec2(13.7, 27.1), opts);
+    imageStore(dest_noise, store_pos, vec4(val, dirt, 0.0, 0.0));
+}
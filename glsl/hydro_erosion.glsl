@@ -8,12 +8,12 @@ layout (local_size_x = WRKGRP_SIZE_X, local_size_y = WRKGRP_SIZE_Y) in;
 layout (binding = 0, rgba32f) uniform readonly image2D heightmap;
 layout (binding = 1, rgba32f) uniform writeonly image2D out_heightmap;
 
-layout (binding = 3, rgba32f) uniform readonly image2D sedimap;
-layout (binding = 4, rgba32f) uniform writeonly image2D out_sedimap;
+layout (binding = 3, SED_FORMAT) uniform readonly image2D sedimap;
+layout (binding = 4, SED_FORMAT) uniform writeonly image2D out_sedimap;
 
 // velocity + suspended sediment vector
 // vec3((u, v), suspended)
-layout (binding = 5, rgba32f)   
+layout (binding = 5, VEL_FORMAT)   
 	uniform readonly image2D velocitymap;
 
 layout (std140, binding = BIND_UNIFORM_EROSION) uniform erosion_data {
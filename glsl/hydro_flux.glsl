@@ -13,14 +13,13 @@ layout (binding = 1, rgba32f)
 
 // (fL, fR, fT, fB) left, right, top, bottom
 layout (binding = 2) uniform sampler2D fluxmap;
-layout (binding = 3, rgba32f)   
+layout (binding = 3, FLUX_FORMAT)   
 	uniform writeonly image2D out_fluxmap;
 
 // velocity + suspended sediment vector
-// vec3((u, v), )
-layout (binding = 4) uniform sampler2D velocitymap;
-layout (binding = 5, rgba32f)   
-	uniform writeonly image2D out_velocitymap;
+// vec3((u, v), ), a cell only touches its own velocity so it's updated in place
+layout (binding = 4, VEL_FORMAT)   
+	uniform image2D velocitymap;
 
 layout (std140, binding = BIND_UNIFORM_EROSION) uniform erosion_data {
     Erosion_data set;
@@ -31,16 +30,16 @@ layout (std140, binding = BIND_UNIFORM_EROSION) uniform erosion_data {
 const float A = 1.0;
 
 float get_wheight(ivec2 pos) {
-    if (pos.x < 0 || pos.x > (gl_WorkGroupSize.x * gl_NumWorkGroups.x - 1) ||
-    pos.y < 0 || pos.y > (gl_WorkGroupSize.y * gl_NumWorkGroups.y - 1)) {
+    if (pos.x < 0 || pos.x > (MAP_SIZE - 1) ||
+    pos.y < 0 || pos.y > (MAP_SIZE - 1)) {
         return 999999999999.0;
     }
     return texelFetch(heightmap, pos, 0).w;
 }
 
 vec4 get_flux(ivec2 pos) {
-    if (pos.x < 0 || pos.x > (gl_WorkGroupSize.x * gl_NumWorkGroups.x - 1) ||
-    pos.y < 0 || pos.y > (gl_WorkGroupSize.y * gl_NumWorkGroups.y - 1)) {
+    if (pos.x < 0 || pos.x > (MAP_SIZE - 1) ||
+    pos.y < 0 || pos.y > (MAP_SIZE - 1)) {
        return vec4(0, 0, 0, 0); 
     }
     return texelFetch(fluxmap, pos, 0);
@@ -48,10 +47,7 @@ vec4 get_flux(ivec2 pos) {
 
 vec2 advect_coords(vec2 coords, vec2 vel, float d_t) {
     vec2 adv = coords - vel * d_t;
-    vec2 max_dims = vec2(
-        gl_WorkGroupSize.x * gl_NumWorkGroups.x - 1,
-        gl_WorkGroupSize.y * gl_NumWorkGroups.y - 1
-    );
+    vec2 max_dims = vec2(MAP_SIZE - 1);
     if (adv.x < 0) {
         adv.x = 0;
     } else if (adv.x > max_dims.x) {
@@ -67,18 +63,12 @@ vec2 advect_coords(vec2 coords, vec2 vel, float d_t) {
     return adv;
 }
 
-vec2 get_lerp_vel(vec2 back_coords) {
-    back_coords.x = clamp(back_coords.x, 0, gl_NumWorkGroups.x * WRKGRP_SIZE_X - 1);
-    back_coords.y = clamp(back_coords.y, 0, gl_NumWorkGroups.y * WRKGRP_SIZE_Y - 1);
-    return img_bilinear(velocitymap, back_coords).xy;
-}
-
 
 void main() {
     ivec2 pos = ivec2(gl_GlobalInvocationID.xy);
     
     vec4 out_flux = get_flux(pos);
-    vec4 vel      = texelFetch(velocitymap, pos, 0);
+    vec4 vel      = imageLoad(velocitymap, pos);
 
     // water height
     vec4 terrain = texelFetch(heightmap, pos, 0);
@@ -109,12 +99,12 @@ void main() {
     // boundary checking */
     if (pos.x <= 0) {
         out_flux.x = 0;
-    } else if (pos.x >= (gl_WorkGroupSize.x * gl_NumWorkGroups.x - 1)) {
+    } else if (pos.x >= (MAP_SIZE - 1)) {
         out_flux.y = 0;
     } 
     if (pos.y <= 0) {
         out_flux.w = 0;
-    } else if (pos.y >= (gl_WorkGroupSize.y * gl_NumWorkGroups.y - 1)) {
+    } else if (pos.y >= (MAP_SIZE - 1)) {
         out_flux.z = 0;
     } 
 
@@ -136,10 +126,6 @@ void main() {
     terrain.b = d2;
     terrain.w = terrain.r + d2 + terrain.g;
 
-    /* // velocity advection
-    vec2 adv_pos = advect_coords(pos, vel.xy / 2.0, set.d_t); 
-    vec2 adv_vel = get_lerp_vel(adv_pos); */
-
     // average water height
     vel.z = (d1 + d2); 
 
@@ -161,6 +147,6 @@ void main() {
     }
 
     imageStore(out_fluxmap, pos, out_flux);
-    imageStore(out_velocitymap, pos, vel);
+    imageStore(velocitymap, pos, vel);
     imageStore(out_heightmap, pos, terrain);
 }
@@ -0,0 +1,21 @@
+#version 460
+
+#include <bindings>
+#include <particle_bins>
+#line 6
+
+// droplets per bin, the CPU clears the bins before this pass
+layout (local_size_x = WRKGRP_SIZE_X * WRKGRP_SIZE_Y) in;
+
+layout(std430, binding = BIND_PARTICLE_MOTION) readonly buffer ParticleMotion {
+    Particle_motion particle_motion[];
+};
+
+layout(std430, binding = BIND_PARTICLE_STATE) readonly buffer ParticleState {
+    Particle_state particle_state[];
+};
+
+void main() {
+    uint id = gl_GlobalInvocationID.x;
+    atomicAdd(bins[particle_bin(particle_motion[id].position, particle_state[id].iters)], 1);
+}
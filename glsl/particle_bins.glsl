@@ -0,0 +1,24 @@
+// droplets sorted by the WRKGRP_SIZE_X x WRKGRP_SIZE_Y tile they are in so
+// neighbouring invocations sample neighbouring texels: a counting sort of
+// particle_bin.glsl (counts), particle_scan.glsl (offsets) and
+// particle_scatter.glsl (reorder), one bin per tile in rows plus a last one
+// for the droplets waiting to spawn
+layout (std430, binding = BIND_PARTICLE_BINS) buffer particle_bins {
+    uint bins[];
+};
+
+uint bin_count() {
+    return (MAP_SIZE / WRKGRP_SIZE_X) * (MAP_SIZE / WRKGRP_SIZE_Y) + 1;
+}
+
+uint particle_bin(vec2 position, int iters) {
+    if (iters == 0) {
+        return bin_count() - 1;
+    }
+    uvec2 row = uvec2(MAP_SIZE / WRKGRP_SIZE_X, MAP_SIZE / WRKGRP_SIZE_Y);
+    uvec2 tile = min(
+        uvec2(max(position * WORLD_SCALE, vec2(0))) / uvec2(WRKGRP_SIZE_X, WRKGRP_SIZE_Y),
+        row - 1
+    );
+    return tile.y * row.x + tile.x;
+}
@@ -0,0 +1,43 @@
+#version 460
+
+#include <bindings>
+#include <particle_live>
+#line 6
+
+// appends the droplets that aren't idle to the live list, the droplets of a
+// workgroup keep their order (and the order of particle_scatter.glsl) in one
+// run of the list, the CPU clears the count and the dispatch size before
+layout (local_size_x = WRKGRP_SIZE_X * WRKGRP_SIZE_Y) in;
+
+#define GROUP_SIZE (WRKGRP_SIZE_X * WRKGRP_SIZE_Y)
+
+layout(std430, binding = BIND_PARTICLE_STATE) readonly buffer ParticleState {
+    Particle_state particle_state[];
+};
+
+// inclusive scan of the live flags of the workgroup
+shared uint group_live[GROUP_SIZE];
+shared uint group_first;
+
+void main() {
+    uint id = gl_GlobalInvocationID.x;
+    uint local = gl_LocalInvocationIndex;
+    bool live = particle_state[id].iters != 0;
+    group_live[local] = live ? 1 : 0;
+    barrier();
+    for (uint offset = 1; offset < GROUP_SIZE; offset <<= 1) {
+        uint prev = local >= offset ? group_live[local - offset] : 0;
+        barrier();
+        group_live[local] += prev;
+        barrier();
+    }
+    if (local == GROUP_SIZE - 1) {
+        uint first = atomicAdd(live_count, group_live[local]);
+        group_first = first;
+        atomicMax(live_groups_x, (first + group_live[local] + GROUP_SIZE - 1) / GROUP_SIZE);
+    }
+    barrier();
+    if (live) {
+        live_ids[group_first + group_live[local] - 1] = id;
+    }
+}
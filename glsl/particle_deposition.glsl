@@ -0,0 +1,139 @@
+// droplet erosion of one step, shared by particle_erosion.glsl and
+// particle_steps.glsl (locked only), the including shader declares the
+// particle streams, the erosion_data block and the images: deposits +
+// heightmap with ATOMIC_DEPOSITION, lockmap + heightmap + momentmap without
+
+// erode all layers on 1 point of a quad, returns the new terrain, only the
+// sediment of the droplet changes
+vec4 erode_layers(uint id, Particle part, vec4 terr, vec2 offset, vec2 old_sediment) {
+    part.sediment = particle_sediment[id];
+    // weighted multiplier for a point on a quad on which the particle is located
+    float multipl = offset.x * offset.y;
+
+    // iterate over all layers
+    float cap = 0.0;
+    for (int i = (SED_LAYERS - 1); i >= 0; i--) {
+        // deposit sediment if the particle is supposed to die
+        if (part.to_kill) {
+            float sed = old_sediment[i] * multipl;
+            terr[i] += sed;
+            part.sediment[i] -= sed;
+            continue;
+        }
+
+        float Kls = set.d_t * set.Ks[i];
+        float Kld = set.d_t * set.Kd[i];
+
+        // sediment transport capacity
+        float c = max(0.0, part.sc - cap);
+
+        float s1 = old_sediment[i];
+        float old_terr = terr[i];
+
+        // dissolve sediment
+        if (c > s1) {
+            float eroded = multipl * Kls * (c - s1);
+            s1 += eroded;
+            terr[i] -= eroded;
+            if (terr[i] < 0) {
+                s1 += terr[i];
+                terr[i] = 0;
+                cap += old_terr;
+            } else {
+                part.sediment[i] = s1;
+                break;
+            }
+        }
+        // deposit sediment
+        else {
+            float deposit = multipl * Kld * (s1 - c);
+            s1 -= deposit;
+            terr[i] += deposit;
+        }
+        part.sediment[i] = s1;
+    }
+    for (uint i = 0; i < (SED_LAYERS - 1); i++) {
+        float conv = part.sediment[i] * set.Kconv * set.d_t;
+        part.sediment[i + 1] += conv;
+        part.sediment[i] -= conv;
+    }
+    particle_sediment[id] = part.sediment;
+    // terr.b += 1e-7 * part.volume * multipl;
+    terr.b += 1e-5 * part.volume * multipl;
+    terr.w = terr.r + terr.b + terr.g;
+    return terr;
+}
+
+vec2 momentum(Particle part, vec2 offset) {
+    return part.volume * part.velocity * offset.x * offset.y;
+}
+
+#ifdef ATOMIC_DEPOSITION
+int fixed_point(float value, uint layer) {
+    return int(round(value * DEPOSIT_SCALE[layer]));
+}
+
+// erodes the terrain from the start of the step, droplets on the same texel
+// don't see each other's changes within a step
+void atomic_erosion(uint id, Particle part, ivec2 pos, vec2 offset, vec2 old_sediment) {
+    vec4 terr = imageLoad(heightmap, pos);
+    vec4 d_terr = erode_layers(id, part, terr, offset, old_sediment) - terr;
+    vec2 d_moment = momentum(part, offset);
+    for (uint i = 0; i < SED_LAYERS + 1; i++) {
+        if (d_terr[i] != 0.0) {
+            imageAtomicAdd(deposits[i], pos, fixed_point(d_terr[i], i));
+        }
+    }
+    imageAtomicAdd(deposits[SED_LAYERS + 1], pos, fixed_point(d_moment.x, SED_LAYERS + 1));
+    imageAtomicAdd(deposits[SED_LAYERS + 2], pos, fixed_point(d_moment.y, SED_LAYERS + 2));
+}
+#else
+// lock a pixel on heightmap and then try to erode the terrain
+// spinlock - acquire
+void atomic_erosion(uint id, Particle part, ivec2 pos, vec2 offset, vec2 old_sediment) {
+    uint lock_available;
+    do {
+        lock_available = imageAtomicCompSwap(lockmap, pos, 0, 1);
+        if (lock_available == 0) {
+            vec4 terr = imageLoad(heightmap, pos);
+            vec4 momentm = imageLoad(momentmap, pos);
+            memoryBarrierImage();
+            terr = erode_layers(id, part, terr, offset, old_sediment);
+            momentm.zw += momentum(part, offset);
+            imageStore(heightmap, pos, terr);
+            imageStore(momentmap, pos, momentm);
+            memoryBarrierImage();
+            // release the lock
+            imageAtomicExchange(lockmap, pos, 0);
+        }
+    } while (lock_available != 0);
+}
+#endif
+
+// erodes the quad around a droplet
+void erode_particle(uint id) {
+    Particle part = load_particle(id);
+    if (part.iters == 0) {
+        return;
+    }
+    // get a quad
+    ivec2 pos[4];
+    //  3---2
+    //  |   |
+    //  0---1
+    pos[0] = ivec2(part.position * WORLD_SCALE);
+    pos[1] = ivec2(part.position * WORLD_SCALE) + ivec2(1, 0);
+    pos[2] = ivec2(part.position * WORLD_SCALE) + ivec2(1, 1);
+    pos[3] = ivec2(part.position * WORLD_SCALE) + ivec2(0, 1);
+    // offset between points inside a quad
+    vec2 offset[4];
+    vec2 off = fract(part.position * WORLD_SCALE);
+    offset[0] = vec2(1.0 - off.x, 1.0 - off.y);
+    offset[1] = vec2(off.x, 1.0 - off.y);
+    offset[2] = vec2(off.x, off.y);
+    offset[3] = vec2(1.0 - off.x, off.y);
+    vec2 sediment = part.sediment;
+    for (uint i = 0; i < 4; i++) {
+        atomic_erosion(id, part, pos[i], offset[i], sediment);
+    }
+}
@@ -0,0 +1,27 @@
+// droplets that move this step while it doesn't rain, particle_compact.glsl
+// collects them and the particle passes are dispatched over the list
+// indirectly, idle droplets (iters == 0) take no invocations
+layout (std430, binding = BIND_PARTICLE_LIVE) buffer particle_live {
+    // glDispatchComputeIndirect arguments
+    uint live_groups_x;
+    uint live_groups_y;
+    uint live_groups_z;
+    uint live_count;
+    uint live_ids[];
+};
+
+// dispatched over the live list instead of the whole buffer
+uniform bool compact;
+
+// droplet of the invocation, false past the end of the live list
+bool particle_id(out uint id) {
+    id = gl_GlobalInvocationID.x;
+    if (!compact) {
+        return true;
+    }
+    if (id >= live_count) {
+        return false;
+    }
+    id = live_ids[id];
+    return true;
+}
@@ -0,0 +1,41 @@
+#version 460
+
+#include <bindings>
+#include <particle_bins>
+#line 6
+
+// turns the counts of the bins into the index of their first droplet, in
+// place, one workgroup: every invocation sums a run of bins, the sums are
+// scanned in shared memory and every run is written out from its offset
+#define SCAN_SIZE 256
+layout (local_size_x = SCAN_SIZE) in;
+
+shared uint run_sums[SCAN_SIZE];
+
+void main() {
+    uint id = gl_LocalInvocationID.x;
+    uint count = bin_count();
+    uint run = (count + SCAN_SIZE - 1) / SCAN_SIZE;
+    uint begin = min(id * run, count);
+    uint end = min(begin + run, count);
+
+    uint sum = 0;
+    for (uint i = begin; i < end; i++) {
+        sum += bins[i];
+    }
+    run_sums[id] = sum;
+    barrier();
+    // inclusive scan of the run sums
+    for (uint offset = 1; offset < SCAN_SIZE; offset <<= 1) {
+        uint prev = id >= offset ? run_sums[id - offset] : 0;
+        barrier();
+        run_sums[id] += prev;
+        barrier();
+    }
+    uint first = run_sums[id] - sum;
+    for (uint i = begin; i < end; i++) {
+        uint bin = bins[i];
+        bins[i] = first;
+        first += bin;
+    }
+}
@@ -0,0 +1,55 @@
+#version 460
+
+#include <bindings>
+#include <particle_bins>
+#line 6
+
+// moves every droplet from the copy of the streams to the next free index of
+// its bin, the order within a bin is whatever order the atomics come in, the
+// CPU clears the kill mask the bits are scattered into
+layout (local_size_x = WRKGRP_SIZE_X * WRKGRP_SIZE_Y) in;
+
+layout(std430, binding = BIND_SCRATCH_MOTION) readonly buffer ScratchMotion {
+    Particle_motion unsorted_motion[];
+};
+
+layout(std430, binding = BIND_SCRATCH_STATE) readonly buffer ScratchState {
+    Particle_state unsorted_state[];
+};
+
+layout(std430, binding = BIND_SCRATCH_SEDIMENT) readonly buffer ScratchSediment {
+    vec2 unsorted_sediment[];
+};
+
+layout(std430, binding = BIND_SCRATCH_KILL) readonly buffer ScratchKill {
+    uint unsorted_kill[];
+};
+
+layout(std430, binding = BIND_PARTICLE_MOTION) writeonly buffer ParticleMotion {
+    Particle_motion particle_motion[];
+};
+
+layout(std430, binding = BIND_PARTICLE_STATE) writeonly buffer ParticleState {
+    Particle_state particle_state[];
+};
+
+layout(std430, binding = BIND_PARTICLE_SEDIMENT) writeonly buffer ParticleSediment {
+    vec2 particle_sediment[];
+};
+
+layout(std430, binding = BIND_PARTICLE_KILL) buffer ParticleKill {
+    uint particle_kill[];
+};
+
+void main() {
+    uint id = gl_GlobalInvocationID.x;
+    Particle_motion motion = unsorted_motion[id];
+    Particle_state state = unsorted_state[id];
+    uint dest = atomicAdd(bins[particle_bin(motion.position, state.iters)], 1);
+    particle_motion[dest] = motion;
+    particle_state[dest] = state;
+    particle_sediment[dest] = unsorted_sediment[id];
+    if ((unsorted_kill[id / 32] & (1u << (id % 32))) != 0) {
+        atomicOr(particle_kill[dest / 32], 1u << (dest % 32));
+    }
+}
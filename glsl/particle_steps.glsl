@@ -0,0 +1,63 @@
+#version 460
+
+#include <bindings>
+#include <particle_live>
+#line 6
+
+// `substeps` droplet steps of movement + erosion in one dispatch, the map
+// passes in between are left out, a droplet reads the maps through the same
+// images it erodes. Locked deposition only, atomic deposits have to be
+// resolved between the droplet steps, see Erosion::particle_step
+layout (local_size_x = WRKGRP_SIZE_X * WRKGRP_SIZE_Y) in;
+
+layout (binding = 0, r32ui) uniform volatile coherent uimage2D lockmap;
+layout (binding = 1, rgba32f) uniform volatile coherent image2D heightmap;
+layout (binding = 2, VEL_FORMAT) uniform volatile coherent image2D momentmap;
+
+layout (std140) uniform map_settings {
+    Map_settings_data map_set;
+};
+
+layout (std140, binding = BIND_UNIFORM_EROSION) uniform erosion_data {
+    Erosion_data set;
+};
+
+#include <particle_streams>
+
+uniform float time;
+uniform uint substeps;
+
+vec4 terrain_at(vec2 pos) {
+    ivec2 p = ivec2(pos * WORLD_SCALE);
+    vec2 f = fract(pos * WORLD_SCALE);
+    return mix(
+        mix(imageLoad(heightmap, p), imageLoad(heightmap, p + ivec2(1, 0)), f.x),
+        mix(imageLoad(heightmap, p + ivec2(0, 1)), imageLoad(heightmap, p + ivec2(1, 1)), f.x),
+        f.y
+    );
+}
+
+vec2 momentum_at(vec2 pos) {
+    ivec2 p = ivec2(pos * WORLD_SCALE);
+    vec2 f = fract(pos * WORLD_SCALE);
+    return mix(
+        mix(imageLoad(momentmap, p).xy, imageLoad(momentmap, p + ivec2(1, 0)).xy, f.x),
+        mix(imageLoad(momentmap, p + ivec2(0, 1)).xy, imageLoad(momentmap, p + ivec2(1, 1)).xy, f.x),
+        f.y
+    );
+}
+
+#include <particle_movement>
+#include <particle_deposition>
+
+void main() {
+    uint id;
+    if (!particle_id(id)) {
+        return;
+    }
+    for (uint i = 0; i < substeps; i++) {
+        // every sub-step spawns the droplets that died in the last one at new positions
+        move_particle(id, time + float(i));
+        erode_particle(id);
+    }
+}
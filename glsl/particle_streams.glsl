@@ -0,0 +1,54 @@
+// droplets of particle erosion as separate streams, a kernel only touches the
+// ones it needs: position + velocity, volume + capacity + age, the sediment of
+// the layers and one kill bit per droplet, see State::World::Particle_streams
+layout(std430, binding = BIND_PARTICLE_MOTION) buffer ParticleMotion {
+    Particle_motion particle_motion[];
+};
+
+layout(std430, binding = BIND_PARTICLE_STATE) buffer ParticleState {
+    Particle_state particle_state[];
+};
+
+layout(std430, binding = BIND_PARTICLE_SEDIMENT) buffer ParticleSediment {
+    vec2 particle_sediment[];
+};
+
+layout(std430, binding = BIND_PARTICLE_KILL) buffer ParticleKill {
+    uint particle_kill[];
+};
+
+bool particle_killed(uint id) {
+    return (particle_kill[id / 32] & (1u << (id % 32))) != 0;
+}
+
+// 32 droplets share a word of the mask
+void set_particle_killed(uint id, bool killed) {
+    if (killed) {
+        atomicOr(particle_kill[id / 32], 1u << (id % 32));
+    } else {
+        atomicAnd(particle_kill[id / 32], ~(1u << (id % 32)));
+    }
+}
+
+Particle load_particle(uint id) {
+    Particle_motion motion = particle_motion[id];
+    Particle_state state = particle_state[id];
+    Particle p;
+    p.position = motion.position;
+    p.velocity = motion.velocity;
+    p.volume = state.volume;
+    p.sc = state.sc;
+    p.iters = state.iters;
+    p.sediment = particle_sediment[id];
+    p.to_kill = particle_killed(id);
+    return p;
+}
+
+void store_particle(uint id, Particle p) {
+    particle_motion[id] = Particle_motion(p.position, p.velocity);
+    particle_state[id] = Particle_state(p.volume, p.sc, p.iters);
+    particle_sediment[id] = p.sediment;
+    if (p.to_kill != particle_killed(id)) {
+        set_particle_killed(id, p.to_kill);
+    }
+}
@@ -2,12 +2,18 @@
 
 #include <bindings>
 #include <simplex_noise>
-#line 6
+#include <tiles>
+#line 7
 
 layout (local_size_x = WRKGRP_SIZE_X, local_size_y = WRKGRP_SIZE_Y) in;
 
-layout (binding = 0, rgba32f) uniform readonly image2D heightmap;
-layout (binding = 1, rgba32f) uniform writeonly image2D out_heightmap;
+// water is added in place, a texel only touches itself
+layout (binding = 0, rgba32f) uniform image2D heightmap;
+
+// picks one of the patterns of rain_pattern.glsl, mirrored and shifted by
+// `time`, instead of evaluating the noise
+uniform bool cached;
+layout (binding = 1) uniform sampler2D patterns[RAIN_PATTERNS];
 
 uniform float time;
 layout (std140, binding = BIND_UNIFORM_RAIN_SETTINGS) 
@@ -29,6 +35,24 @@ float hash(vec2 p) {
     return fract(p.x*p.y*(p.x+p.y));
 }
 
+// the pattern texel of `pos` for this rain event, the same for every invocation
+float cached_rain(ivec2 pos) {
+    int size = int(MAP_SIZE);
+    float event = fract(time * 1.372914227e3) * 1000.0;
+    uint pattern = uint(hash(vec2(event, 0.5)) * RAIN_PATTERNS) % RAIN_PATTERNS;
+    ivec2 offset = ivec2(
+        hash(vec2(event, 1.5)) * float(2 * size),
+        hash(vec2(event, 2.5)) * float(2 * size)
+    );
+    // mirrored repeat keeps the shifted pattern continuous
+    ivec2 p = (pos + offset) % (2 * size);
+    p = mix(p, 2 * size - 1 - p, greaterThanEqual(p, ivec2(size)));
+    if (hash(vec2(event, 3.5)) > 0.5) {
+        p = p.yx;
+    }
+    return texelFetch(patterns[pattern], p, 0).r;
+}
+
 void main() {
     ivec2 pos = ivec2(gl_GlobalInvocationID.xy);
     vec4 terr = imageLoad(heightmap, pos);
@@ -43,7 +67,7 @@ void main() {
         false,
         false
     );
-    float r = max(0.0, gln_sfbm(gl_GlobalInvocationID.xy, opts));
+    float r = cached ? cached_rain(pos) : max(0.0, gln_sfbm(gl_GlobalInvocationID.xy, opts));
 
     float incr = set.amount * r;
     float mountain = terr.w - map_set.max_height * set.mountain_thresh;
@@ -52,5 +76,9 @@ void main() {
     }
     terr.b += incr;
     terr.w = terr.r + terr.g + terr.b;
-    imageStore(out_heightmap, pos, terr);
+    imageStore(heightmap, pos, terr);
+    // wakes the tile up for sparse runs
+    if (incr > 0) {
+        tile_state[tile_index(gl_WorkGroupID.xy, MAP_SIZE)] = 0;
+    }
 }
@@ -0,0 +1,30 @@
+#version 460
+
+#include <bindings>
+#include <simplex_noise>
+#line 6
+
+// the rain noise of rain.glsl evaluated once for RAIN_PATTERNS seeds, rain
+// events of the cached rain only look them up, redone when `drops` changes
+layout (local_size_x = WRKGRP_SIZE_X, local_size_y = WRKGRP_SIZE_Y) in;
+
+layout (binding = 0, r16f) uniform writeonly image2D patterns[RAIN_PATTERNS];
+
+uniform float drops;
+
+void main() {
+    ivec2 pos = ivec2(gl_GlobalInvocationID.xy);
+    for (int i = 0; i < RAIN_PATTERNS; i++) {
+        gln_tFBMOpts opts = gln_tFBMOpts(
+            137.0 * float(i + 1),
+            0.5,
+            2.0,
+            drops,
+            1,
+            8,
+            false,
+            false
+        );
+        imageStore(patterns[i], pos, vec4(max(0.0, gln_sfbm(vec2(pos), opts))));
+    }
+}
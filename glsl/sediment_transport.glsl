@@ -2,7 +2,8 @@
 
 #include <bindings>
 #include <img_interpolation>
-#line 5
+#include <tiles>
+#line 6
 
 layout (local_size_x = WRKGRP_SIZE_X, local_size_y = WRKGRP_SIZE_Y) in;
 
@@ -16,7 +17,7 @@ layout (binding = 1, rgba32f)
 layout (binding = 2) uniform sampler2D velocitymap;
 
 layout (binding = 3) uniform sampler2D sedimap;
-layout (binding = 4, rgba32f)   
+layout (binding = 4, SED_FORMAT)   
 	uniform writeonly image2D out_sedimap;
 
 layout (std140, binding = BIND_UNIFORM_EROSION) uniform erosion_data {
@@ -24,17 +25,15 @@ layout (std140, binding = BIND_UNIFORM_EROSION) uniform erosion_data {
 };
 
 vec4 get_lerp_sed(vec2 back_coords) {
-    back_coords.x = clamp(back_coords.x, 0, gl_NumWorkGroups.x * WRKGRP_SIZE_X - 1);
-    back_coords.y = clamp(back_coords.y, 0, gl_NumWorkGroups.y * WRKGRP_SIZE_Y - 1);
+    ivec2 size = ivec2(MAP_SIZE);
+    back_coords.x = clamp(back_coords.x, 0, size.x - 1);
+    back_coords.y = clamp(back_coords.y, 0, size.y - 1);
     return img_bilinear(sedimap, back_coords);
 }
 
 vec2 advect_coords(vec2 coords, vec2 vel, float d_t) {
     vec2 adv = coords - vel * d_t;
-    vec2 max_dims = vec2(
-        gl_WorkGroupSize.x * gl_NumWorkGroups.x - 1,
-        gl_WorkGroupSize.y * gl_NumWorkGroups.y - 1
-    );
+    vec2 max_dims = vec2(MAP_SIZE - 1);
     if (adv.x < 0) {
         adv.x = 0;
     } else if (adv.x > max_dims.x) {
@@ -64,7 +63,7 @@ vec2 mac_cormack_backward(vec2 currentCoords, sampler2D velocityField, float dt)
 }
 
 void main() {
-    ivec2 pos = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 pos = tile_pos();
 
     vec4 vel = texelFetch(velocitymap, pos, 0);
     vec2 back_coords = vec2(pos.x - vel.x * set.d_t, pos.y - vel.y * set.d_t);
@@ -14,10 +14,9 @@ layout (std140, binding = BIND_UNIFORM_EROSION) uniform erosion_data {
     Erosion_data set;
 };
 
-layout (binding = 5, rgba32f)   
+// decayed in place, every cell only touches its own momentum
+layout (binding = 5, VEL_FORMAT)   
 	uniform image2D momentmap;
-layout (binding = 6, rgba32f)   
-	uniform image2D out_momentmap;
 
 void main() {
     float d_time = set.d_t;
@@ -25,8 +24,8 @@ void main() {
     vec4 terrain = imageLoad(heightmap, pos);
     vec2 terr = terrain.rg;
     if (pos.x == 0 || pos.y == 0 
-        || pos.x == (gl_NumWorkGroups.x * WRKGRP_SIZE_X - 1)
-        || pos.y == (gl_NumWorkGroups.y * WRKGRP_SIZE_Y - 1)
+        || pos.x == (MAP_SIZE - 1)
+        || pos.y == (MAP_SIZE - 1)
     ) {
         imageStore(out_heightmap, pos, terrain);
         return;
@@ -73,7 +72,8 @@ void main() {
 
     float multip = clamp(set.Kspeed[1] * d_time, 0, 1);
     // water display on particles
-    if (set.particle_count != 0) {
+#ifdef PARTICLE_EROSION
+    {
         vec4 momentum = imageLoad(momentmap, pos);
         momentum.xy *= clamp(1 - (1e-12 * set.particle_count), 0, 1);
         momentum.xy += (1e-12 * set.particle_count) * momentum.zw;
@@ -81,8 +81,8 @@ void main() {
 
         terrain.b *= clamp(1 - (8e-8 * set.particle_count), 0, 1);
         if (pos.x == 0 || pos.y == 0 || 
-            pos.x == (gl_WorkGroupSize.x * gl_NumWorkGroups.x - 1) ||
-            pos.y == (gl_WorkGroupSize.y * gl_NumWorkGroups.y - 1) ||
+            pos.x == (MAP_SIZE - 1) ||
+            pos.y == (MAP_SIZE - 1) ||
             terrain.b < 1e-6
         ) {
             terrain.b = 0;
@@ -90,9 +90,10 @@ void main() {
         if (length(momentum.xy) < 1e-12) {
             momentum.xy = vec2(0);
         }
-        imageStore(out_momentmap, pos, momentum);
+        imageStore(momentmap, pos, momentum);
         multip = clamp(set.Kspeed[1] * d_time, 0, 1);
     }
+#endif
 
     // multip = 1.0;
 
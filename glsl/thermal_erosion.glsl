@@ -6,52 +6,49 @@
 layout (local_size_x = WRKGRP_SIZE_X, local_size_y = WRKGRP_SIZE_Y) in;
 
 layout (binding = 3) uniform sampler2D heightmap;
-layout (binding = 1, rgba32f) uniform writeonly image2D out_thflux_c;
-layout (binding = 2, rgba32f) uniform writeonly image2D out_thflux_d;
+// cross and diagonal outflow of every layer
+layout (binding = 1, THFLUX_FORMAT) uniform writeonly image2D out_thflux_c[SED_LAYERS];
+layout (binding = 1 + SED_LAYERS, THFLUX_FORMAT) uniform writeonly image2D out_thflux_d[SED_LAYERS];
 
 layout (std140, binding = BIND_UNIFORM_EROSION) uniform erosion_data {
     Erosion_data set;
 };
 
-uniform int t_layer;
-
 const float a = L;
 
-vec4 get_height(ivec2 pos) {
-    if (pos.x < 0 || pos.x > (gl_WorkGroupSize.x * gl_NumWorkGroups.x - 1) ||
-    pos.y < 0 || pos.y > (gl_WorkGroupSize.y * gl_NumWorkGroups.y - 1)) {
-        return vec4(999999999999.0);
+// layer heights of the workgroup plus a one cell border, loaded once for all layers
+#define TILE_X (WRKGRP_SIZE_X + 2)
+#define TILE_Y (WRKGRP_SIZE_Y + 2)
+shared vec2 tile[TILE_Y][TILE_X];
+
+vec2 get_height(ivec2 pos) {
+    if (pos.x < 0 || pos.x > (MAP_SIZE - 1) ||
+    pos.y < 0 || pos.y > (MAP_SIZE - 1)) {
+        return vec2(999999999999.0);
     }
-    return texelFetch(heightmap, pos, 0);
+    return texelFetch(heightmap, pos, 0).rg;
 }
 
-void store_outflow(ivec2 pos, vec4 terrain, int layer) {
-    // total height difference
-    vec4 d_h[2] = {vec4(0), vec4(0)};
-
-    for (int i = 0; i <= layer; i++) {
-        // cross
-        d_h[0].x += terrain[i] - get_height(pos + ivec2(-1, 0))[i]; // L
-        d_h[0].y += terrain[i] - get_height(pos + ivec2( 1, 0))[i]; // R
-        d_h[0].z += terrain[i] - get_height(pos + ivec2( 0, 1))[i]; // T
-        d_h[0].w += terrain[i] - get_height(pos + ivec2( 0,-1))[i]; // B
-                           
-        // diagonal        
-        d_h[1].x += terrain[i] - get_height(pos + ivec2(-1, 1))[i]; // LT
-        d_h[1].y += terrain[i] - get_height(pos + ivec2( 1, 1))[i]; // RT
-        d_h[1].z += terrain[i] - get_height(pos + ivec2(-1,-1))[i]; // LB
-        d_h[1].w += terrain[i] - get_height(pos + ivec2( 1,-1))[i]; // RB
+void load_tile() {
+    ivec2 origin = ivec2(gl_WorkGroupID.xy * gl_WorkGroupSize.xy) - ivec2(1);
+    for (uint i = gl_LocalInvocationIndex; i < TILE_X * TILE_Y; i += WRKGRP_SIZE_X * WRKGRP_SIZE_Y) {
+        ivec2 t = ivec2(i % TILE_X, i / TILE_X);
+        tile[t.y][t.x] = get_height(origin + t);
     }
+    barrier();
+}
+
+vec2 tile_height(ivec2 offset) {
+    ivec2 t = ivec2(gl_LocalInvocationID.xy) + ivec2(1) + offset;
+    return tile[t.y][t.x];
+}
 
+void store_outflow(ivec2 pos, vec2 terrain, int layer, vec4 d_h[2]) {
     float H = 0;
-    // uint imax, jmax;
     for (uint j = 0; j < 2; j++) {
         for (uint i = 0; i < 4; i++) {
             if (d_h[j][i] > H) {
                 H = d_h[j][i];
-                /*
-                imax = i;
-                jmax = j; */
             }
         }
     }
@@ -74,7 +71,6 @@ void store_outflow(ivec2 pos, vec4 terrain, int layer) {
             }
             float alph = atan(b / (d / WORLD_SCALE));
             float Kl_alph = set.Kalpha[layer];
-            // float Kl_alph = set.Kalpha;
             if (alph > Kl_alph) {
                 // speed up when the angle is too big
                 float newsh = 1.0 + alph - Kl_alph;
@@ -93,7 +89,6 @@ void store_outflow(ivec2 pos, vec4 terrain, int layer) {
     float Klspeed = set.Kspeed[layer];
 
     float S = set.d_t * Klspeed * sharpness * a * H / 2.0;
-    // float S = set.d_t * set.Kspeed * a * H / 2.0;
 
     for (uint j = 0; j < 2; j++) {
         for (uint i = 0; i < 4; i++) {
@@ -104,12 +99,35 @@ void store_outflow(ivec2 pos, vec4 terrain, int layer) {
             }
         }
     }
-    imageStore(out_thflux_c, pos, out_thfl[0]);
-    imageStore(out_thflux_d, pos, out_thfl[1]);
+    imageStore(out_thflux_c[layer], pos, out_thfl[0]);
+    imageStore(out_thflux_d[layer], pos, out_thfl[1]);
 }
 
 void main() {
+    load_tile();
     ivec2 pos = ivec2(gl_GlobalInvocationID.xy);
-    vec4 terrain = texelFetch(heightmap, pos, 0);
-    store_outflow(pos, terrain, t_layer);
+    vec2 terrain = tile_height(ivec2(0));
+    vec2 nb[8] = {
+        // cross
+        tile_height(ivec2(-1, 0)), // L
+        tile_height(ivec2( 1, 0)), // R
+        tile_height(ivec2( 0, 1)), // T
+        tile_height(ivec2( 0,-1)), // B
+        // diagonal
+        tile_height(ivec2(-1, 1)), // LT
+        tile_height(ivec2( 1, 1)), // RT
+        tile_height(ivec2(-1,-1)), // LB
+        tile_height(ivec2( 1,-1))  // RB
+    };
+
+    // height difference of a layer includes all layers below it
+    vec4 d_h[2] = {vec4(0), vec4(0)};
+    for (int layer = 0; layer < SED_LAYERS; layer++) {
+        for (uint j = 0; j < 2; j++) {
+            for (uint i = 0; i < 4; i++) {
+                d_h[j][i] += terrain[layer] - nb[j * 4 + i][layer];
+            }
+        }
+        store_outflow(pos, terrain, layer, d_h);
+    }
 }
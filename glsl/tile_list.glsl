@@ -0,0 +1,31 @@
+#version 460
+
+#include <bindings>
+#include <tiles>
+#line 6
+
+// one invocation per tile, a tile is dispatched while it is settling or when
+// a neighbour holds water that can flow into it, the dispatch size is counted
+// up from 0, the CPU clears it before this pass
+layout (local_size_x = WRKGRP_SIZE_X * WRKGRP_SIZE_Y) in;
+
+void main() {
+    int row = int(MAP_SIZE / WRKGRP_SIZE_X);
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= row * row) {
+        return;
+    }
+    ivec2 tile = ivec2(index % row, index / row);
+    bool listed = tile_state[index] < TILE_QUIET;
+    for (int y = max(0, tile.y - 1); !listed && y <= min(row - 1, tile.y + 1); y++) {
+        for (int x = max(0, tile.x - 1); x <= min(row - 1, tile.x + 1); x++) {
+            if (tile_state[y * row + x] == 0) {
+                listed = true;
+                break;
+            }
+        }
+    }
+    if (listed) {
+        tiles[atomicAdd(tile_groups_x, 1)] = uint(tile.x) | (uint(tile.y) << 16);
+    }
+}
@@ -0,0 +1,40 @@
+// sparse grid erosion over the WRKGRP_SIZE_X x WRKGRP_SIZE_Y tiles of the map,
+// tile_list.glsl collects the tiles near water into a list which the grid
+// passes are dispatched over indirectly, one workgroup per tile
+
+// steps since a tile last held water, inflow or sediment, saturates at
+// TILE_QUIET, a tile runs for TILE_QUIET steps after it dried up so both
+// copies of the texture pairs settle and skipping it changes nothing
+#define TILE_QUIET 2u
+layout (std430, binding = BIND_TILE_STATE) buffer tile_states {
+    uint tile_state[];
+};
+
+layout (std430, binding = BIND_TILE_LIST) buffer tile_list {
+    // glDispatchComputeIndirect arguments
+    uint tile_groups_x;
+    uint tile_groups_y;
+    uint tile_groups_z;
+    uint tile_pad;
+    // x | y << 16
+    uint tiles[];
+};
+
+// dispatched over the tile list instead of the whole map
+uniform bool sparse;
+
+uvec2 tile_id() {
+    if (sparse) {
+        uint tile = tiles[gl_WorkGroupID.x];
+        return uvec2(tile & 0xffffu, tile >> 16);
+    }
+    return gl_WorkGroupID.xy;
+}
+
+ivec2 tile_pos() {
+    return ivec2(tile_id() * uvec2(WRKGRP_SIZE_X, WRKGRP_SIZE_Y) + gl_LocalInvocationID.xy);
+}
+
+uint tile_index(uvec2 tile, uint map_size) {
+    return tile.y * (map_size / WRKGRP_SIZE_X) + tile.x;
+}
@@ -0,0 +1,22 @@
+// water pyramid of the multigrid water solver: every level halves the map, a
+// texel holds (terrain, water, water after restriction, 0), the terrain of a
+// coarse texel puts its water surface at the mean level of the wet texels
+// below it so lakes stay flat on every level, dry ones take the highest
+// terrain below them so ridges hold the water back on coarse levels too
+// restricted with water_restrict.glsl, relaxed with water_outflow.glsl +
+// water_update.glsl and the change prolonged back with water_prolong.glsl,
+// level 0 is the heightmap itself
+
+// water thinner than this doesn't count as a lake surface
+const float WET = 1e-4;
+
+// 0 = -x, 1 = +x, 2 = +y, 3 = -y as the flux of the pipe model
+const ivec2 NEIGHBOUR[4] = ivec2[](ivec2(-1, 0), ivec2(1, 0), ivec2(0, 1), ivec2(0, -1));
+
+ivec2 level_size() {
+    return ivec2(gl_NumWorkGroups.xy * gl_WorkGroupSize.xy);
+}
+
+bool in_level(ivec2 pos) {
+    return all(greaterThanEqual(pos, ivec2(0))) && all(lessThan(pos, level_size()));
+}
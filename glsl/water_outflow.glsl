@@ -0,0 +1,37 @@
+#version 460
+
+#include <bindings>
+#line 5
+
+// first half of a relaxation sweep of a level: the water every texel gives
+// its lower neighbours, the levels have closed borders as the heightmap
+layout (local_size_x = WRKGRP_SIZE_X, local_size_y = WRKGRP_SIZE_Y) in;
+
+#include <water_levels>
+
+layout (binding = 0, rgba32f) uniform readonly image2D level;
+// (-x, +x, +y, -y)
+layout (binding = 1, rgba32f) uniform writeonly image2D outflow;
+
+// share of the difference of the surfaces moved per sweep, stable below 0.25
+const float RELAX = 0.2;
+
+void main() {
+    ivec2 pos = ivec2(gl_GlobalInvocationID.xy);
+    vec2 cell = imageLoad(level, pos).rg;
+    float surface = cell.x + cell.y;
+    vec4 out_water = vec4(0.0);
+    for (int i = 0; i < 4; i++) {
+        ivec2 n = pos + NEIGHBOUR[i];
+        if (in_level(n)) {
+            vec2 other = imageLoad(level, n).rg;
+            out_water[i] = RELAX * max(0.0, surface - other.x - other.y);
+        }
+    }
+    // never more than the texel holds
+    float total = out_water.x + out_water.y + out_water.z + out_water.w;
+    if (total > cell.y) {
+        out_water *= cell.y / total;
+    }
+    imageStore(outflow, pos, out_water);
+}
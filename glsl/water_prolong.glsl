@@ -0,0 +1,46 @@
+#version 460
+
+#include <bindings>
+#include <tiles>
+#line 6
+
+// the change of a coarse texel since its restriction applied to the 2x2
+// texels below it, dispatched over the coarser level: water it gained is
+// spread evenly, water it lost is taken in proportion to what they hold so
+// none goes below 0, both keep the volume
+layout (local_size_x = WRKGRP_SIZE_X, local_size_y = WRKGRP_SIZE_Y) in;
+
+#include <water_levels>
+
+// the heightmap when `top` is set, a level of the pyramid otherwise
+layout (binding = 0, rgba32f) uniform image2D heightmap;
+layout (binding = 1, rgba32f) uniform image2D fine_level;
+layout (binding = 2, rgba32f) uniform readonly image2D coarse_level;
+
+uniform bool top;
+
+void main() {
+    ivec2 pos = ivec2(gl_GlobalInvocationID.xy);
+    vec4 coarse = imageLoad(coarse_level, pos);
+    float gained = coarse.g - coarse.b;
+    if (gained == 0.0) {
+        return;
+    }
+    float kept = gained < 0.0 ? coarse.g / coarse.b : 1.0;
+    for (int i = 0; i < 4; i++) {
+        ivec2 fine = 2 * pos + ivec2(i & 1, i >> 1);
+        if (top) {
+            vec4 terr = imageLoad(heightmap, fine);
+            terr.b = gained < 0.0 ? terr.b * kept : terr.b + gained;
+            terr.w = terr.r + terr.g + terr.b;
+            imageStore(heightmap, fine, terr);
+            // only the read half of the heightmap pair holds the water, wakes
+            // the tile up so a sparse grid step carries it over
+            tile_state[tile_index(uvec2(fine) / uvec2(WRKGRP_SIZE_X, WRKGRP_SIZE_Y), MAP_SIZE)] = 0;
+        } else {
+            vec4 cell = imageLoad(fine_level, fine);
+            cell.g = gained < 0.0 ? cell.g * kept : cell.g + gained;
+            imageStore(fine_level, fine, cell);
+        }
+    }
+}
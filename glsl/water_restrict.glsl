@@ -0,0 +1,45 @@
+#version 460
+
+#include <bindings>
+#line 5
+
+// one texel of the coarser level from 2x2 texels of the finer one, dispatched
+// over the coarser level
+layout (local_size_x = WRKGRP_SIZE_X, local_size_y = WRKGRP_SIZE_Y) in;
+
+#include <water_levels>
+
+// the heightmap when `top` is set, a level of the pyramid otherwise
+layout (binding = 0, rgba32f) uniform readonly image2D heightmap;
+layout (binding = 1, rgba32f) uniform readonly image2D fine_level;
+layout (binding = 2, rgba32f) uniform writeonly image2D coarse_level;
+
+uniform bool top;
+
+void main() {
+    ivec2 pos = ivec2(gl_GlobalInvocationID.xy);
+    // highest terrain of the dry texels
+    float terrain = 0.0;
+    float water = 0.0;
+    float wet_surface = 0.0;
+    float wet = 0.0;
+    for (int i = 0; i < 4; i++) {
+        ivec2 fine = 2 * pos + ivec2(i & 1, i >> 1);
+        vec2 cell;
+        if (top) {
+            vec4 terr = imageLoad(heightmap, fine);
+            cell = vec2(terr.r + terr.g, terr.b);
+        } else {
+            cell = imageLoad(fine_level, fine).rg;
+        }
+        terrain = max(terrain, cell.x);
+        water += cell.y;
+        if (cell.y > WET) {
+            wet_surface += cell.x + cell.y;
+            wet += 1.0;
+        }
+    }
+    water *= 0.25;
+    terrain = wet > 0.0 ? wet_surface / wet - water : terrain;
+    imageStore(coarse_level, pos, vec4(terrain, water, water, 0.0));
+}
@@ -0,0 +1,29 @@
+#version 460
+
+#include <bindings>
+#line 5
+
+// second half of a relaxation sweep of a level: the water of every texel
+// after its outflow and the outflow of its neighbours towards it
+layout (local_size_x = WRKGRP_SIZE_X, local_size_y = WRKGRP_SIZE_Y) in;
+
+#include <water_levels>
+
+layout (binding = 0, rgba32f) uniform image2D level;
+layout (binding = 1, rgba32f) uniform readonly image2D outflow;
+
+void main() {
+    ivec2 pos = ivec2(gl_GlobalInvocationID.xy);
+    vec4 cell = imageLoad(level, pos);
+    vec4 out_water = imageLoad(outflow, pos);
+    float water = cell.g - (out_water.x + out_water.y + out_water.z + out_water.w);
+    for (int i = 0; i < 4; i++) {
+        ivec2 n = pos + NEIGHBOUR[i];
+        if (in_level(n)) {
+            // the opposite direction of the neighbour: -x <-> +x, +y <-> -y
+            water += imageLoad(outflow, n)[i ^ 1];
+        }
+    }
+    cell.g = max(0.0, water);
+    imageStore(level, pos, cell);
+}
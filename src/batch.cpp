@@ -0,0 +1,778 @@
+#include "batch.hpp"
+#include "profiler.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+// synthetic clock for rain/particle spawning, keeps batch runs reproducible
+constexpr float BATCH_STEP_TIME = 1.f / 60.f;
+// default tolerances of the validations: the CPU grid follows the GPU one closely,
+// half floats drift by up to ~0.8 after 1000 steps on a 256 map
+constexpr float CPU_TOLERANCE = 0.05f;
+constexpr float PRECISION_TOLERANCE = 1.0f;
+
+static bool parse_u32(const char* str, u32& out) {
+    // strtoul wraps negative numbers around instead of failing
+    if (strchr(str, '-') != nullptr) {
+        return false;
+    }
+    char* end = nullptr;
+    const auto val = strtoul(str, &end, 10);
+    if (end == str || *end != '\0') {
+        return false;
+    }
+    out = val;
+    return true;
+}
+
+static bool parse_float(const char* str, float& out) {
+    char* end = nullptr;
+    const auto val = strtof(str, &end);
+    if (end == str || *end != '\0') {
+        return false;
+    }
+    out = val;
+    return true;
+}
+
+void Batch::print_usage(const char* program_name) {
+    LOG("usage: {} [--headless] [options]\n"
+        "  --headless          run erosion without a window and exit\n"
+        "  --steps N           erosion steps to run (default 10000)\n"
+        "  --out PATH          output heightmap, greyscale PFM (default heightmap.pfm)\n"
+        "  --timings PATH      write mean GPU time of every pass as CSV\n"
+        "  --rain-steps N      GPU: rain only in the first N steps (default all)\n"
+        "  --size N            map size, overrides config.ini\n"
+        "  --type grid|particle\n"
+        "  --grid-kernel fused|split  fused flux + erosion pass or the separate passes\n"
+        "  --precision full|reduced   storage of flux, velocity, sediment and thermal fields\n"
+        "  --adaptive-step N   grid erosion: CFL time step recomputed every N steps, 0 = fixed\n"
+        "  --sparse on|off     fused grid kernel only on the tiles near water\n"
+        "  --multigrid N       grid erosion: water redistributed over coarser levels every N steps\n"
+        "  --rain noise|cached grid erosion: rain noise evaluated per event or looked up in cached patterns\n"
+        "  --particles N       particle count for particle erosion\n"
+        "  --deposition lock|atomic  droplets lock texels or add fixed point deltas atomically\n"
+        "  --particle-sort N   sort the droplets by map tile every N steps, 0 = never\n"
+        "  --substeps N        droplet steps per particle step, thermal erosion once per step\n"
+        "  --compact on|off    droplet passes only over the droplets still moving when dry\n"
+        "  --seed F            heightmap seed\n"
+        "  --backend gpu|cpu   run erosion on the GPU (default) or on CPU threads\n"
+        "  --threads N         CPU worker threads (default: all hardware threads)\n"
+        "  --in PATH           CPU backend: start from a greyscale PFM loaded as rock\n"
+        "  --validate-cpu      run the CPU grid next to the GPU one and compare them\n"
+        "  --validate-precision  run a full precision grid next to the reduced one and compare them\n"
+        "  --tolerance F       max. terrain height difference for the validations\n"
+        "                      (default 0.05 vs the CPU, 1.0 vs full precision)",
+        program_name);
+}
+
+Opt<Batch::Options> Batch::parse_args(int argc, char* argv[]) {
+    Options opts;
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* val = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        auto needs_value = [&]() {
+            if (val == nullptr) {
+                LOG_ERR("Missing value for {}", arg);
+                return false;
+            }
+            i++;
+            return true;
+        };
+        if (!strcmp(arg, "--help") || !strcmp(arg, "-h")) {
+            return std::nullopt;
+        } else if (!strcmp(arg, "--headless")) {
+            opts.headless = true;
+        } else if (!strcmp(arg, "--steps")) {
+            if (!needs_value() || !parse_u32(val, opts.steps)) {
+                return std::nullopt;
+            }
+        } else if (!strcmp(arg, "--out")) {
+            if (!needs_value()) {
+                return std::nullopt;
+            }
+            opts.output = val;
+        } else if (!strcmp(arg, "--timings")) {
+            if (!needs_value()) {
+                return std::nullopt;
+            }
+            opts.timings = val;
+        } else if (!strcmp(arg, "--rain-steps")) {
+            u32 rain_steps;
+            if (!needs_value() || !parse_u32(val, rain_steps)) {
+                return std::nullopt;
+            }
+            opts.rain_steps = rain_steps;
+        } else if (!strcmp(arg, "--size")) {
+            u32 size;
+            if (!needs_value() || !parse_u32(val, size)) {
+                return std::nullopt;
+            }
+            if (size == 0 || size % WRKGRP_SIZE_X || size % WRKGRP_SIZE_Y) {
+                LOG_ERR("Map size {} is not a multiple of the workgroup size", size);
+                return std::nullopt;
+            }
+            opts.map_size = size;
+        } else if (!strcmp(arg, "--particles")) {
+            u32 count;
+            if (!needs_value() || !parse_u32(val, count)) {
+                return std::nullopt;
+            }
+            // droplets are dispatched in whole workgroups
+            if (count == 0 || count % (WRKGRP_SIZE_X * WRKGRP_SIZE_Y)) {
+                LOG_ERR("Particle count {} is not a multiple of the workgroup size", count);
+                return std::nullopt;
+            }
+            opts.particle_count = count;
+        } else if (!strcmp(arg, "--type")) {
+            if (!needs_value()) {
+                return std::nullopt;
+            }
+            if (!strcmp(val, "grid")) {
+                opts.type = Erosion::Programs::GRID;
+            } else if (!strcmp(val, "particle")) {
+                opts.type = Erosion::Programs::PARTICLES;
+            } else {
+                LOG_ERR("Unknown erosion type: {}", val);
+                return std::nullopt;
+            }
+        } else if (!strcmp(arg, "--grid-kernel")) {
+            if (!needs_value()) {
+                return std::nullopt;
+            }
+            if (!strcmp(val, "fused")) {
+                opts.fused_grid = true;
+            } else if (!strcmp(val, "split")) {
+                opts.fused_grid = false;
+            } else {
+                LOG_ERR("Unknown grid kernel: {}", val);
+                return std::nullopt;
+            }
+        } else if (!strcmp(arg, "--precision")) {
+            if (!needs_value()) {
+                return std::nullopt;
+            }
+            if (!strcmp(val, "full")) {
+                opts.precision = State::World::FULL;
+            } else if (!strcmp(val, "reduced")) {
+                opts.precision = State::World::REDUCED;
+            } else {
+                LOG_ERR("Unknown precision: {}", val);
+                return std::nullopt;
+            }
+        } else if (!strcmp(arg, "--adaptive-step")) {
+            u32 period;
+            if (!needs_value() || !parse_u32(val, period)) {
+                return std::nullopt;
+            }
+            opts.adaptive_period = period;
+        } else if (!strcmp(arg, "--multigrid")) {
+            u32 period;
+            if (!needs_value() || !parse_u32(val, period)) {
+                return std::nullopt;
+            }
+            opts.multigrid_period = period;
+        } else if (!strcmp(arg, "--rain")) {
+            if (!needs_value()) {
+                return std::nullopt;
+            }
+            if (!strcmp(val, "noise")) {
+                opts.cached_rain = false;
+            } else if (!strcmp(val, "cached")) {
+                opts.cached_rain = true;
+            } else {
+                LOG_ERR("Unknown rain: {}", val);
+                return std::nullopt;
+            }
+        } else if (!strcmp(arg, "--sparse")) {
+            if (!needs_value()) {
+                return std::nullopt;
+            }
+            if (!strcmp(val, "on")) {
+                opts.sparse_grid = true;
+            } else if (!strcmp(val, "off")) {
+                opts.sparse_grid = false;
+            } else {
+                LOG_ERR("Unknown --sparse value: {}", val);
+                return std::nullopt;
+            }
+        } else if (!strcmp(arg, "--deposition")) {
+            if (!needs_value()) {
+                return std::nullopt;
+            }
+            if (!strcmp(val, "lock")) {
+                opts.deposition = State::World::LOCKED;
+            } else if (!strcmp(val, "atomic")) {
+                opts.deposition = State::World::ATOMIC;
+            } else {
+                LOG_ERR("Unknown deposition: {}", val);
+                return std::nullopt;
+            }
+        } else if (!strcmp(arg, "--particle-sort")) {
+            u32 period;
+            if (!needs_value() || !parse_u32(val, period)) {
+                return std::nullopt;
+            }
+            opts.sort_period = period;
+        } else if (!strcmp(arg, "--substeps")) {
+            u32 substeps;
+            if (!needs_value() || !parse_u32(val, substeps) || substeps == 0) {
+                return std::nullopt;
+            }
+            opts.substeps = substeps;
+        } else if (!strcmp(arg, "--compact")) {
+            if (!needs_value()) {
+                return std::nullopt;
+            }
+            if (!strcmp(val, "on")) {
+                opts.compact_particles = true;
+            } else if (!strcmp(val, "off")) {
+                opts.compact_particles = false;
+            } else {
+                LOG_ERR("Unknown --compact value: {}", val);
+                return std::nullopt;
+            }
+        } else if (!strcmp(arg, "--seed")) {
+            float seed;
+            if (!needs_value() || !parse_float(val, seed)) {
+                return std::nullopt;
+            }
+            opts.seed = seed;
+        } else if (!strcmp(arg, "--backend")) {
+            if (!needs_value()) {
+                return std::nullopt;
+            }
+            if (!strcmp(val, "gpu")) {
+                opts.backend = Options::GPU;
+            } else if (!strcmp(val, "cpu")) {
+                opts.backend = Options::CPU;
+            } else {
+                LOG_ERR("Unknown backend: {}", val);
+                return std::nullopt;
+            }
+        } else if (!strcmp(arg, "--threads")) {
+            if (!needs_value() || !parse_u32(val, opts.threads)) {
+                return std::nullopt;
+            }
+        } else if (!strcmp(arg, "--in")) {
+            if (!needs_value()) {
+                return std::nullopt;
+            }
+            opts.input = val;
+        } else if (!strcmp(arg, "--validate-cpu")) {
+            opts.validate_cpu = true;
+        } else if (!strcmp(arg, "--validate-precision")) {
+            opts.validate_precision = true;
+        } else if (!strcmp(arg, "--tolerance")) {
+            float tolerance;
+            if (!needs_value() || !parse_float(val, tolerance)) {
+                return std::nullopt;
+            }
+            opts.tolerance = tolerance;
+        } else {
+            LOG_ERR("Unknown argument: {}", arg);
+            return std::nullopt;
+        }
+    }
+    // the CPU engine has no renderer, always a batch run
+    if (opts.backend == Options::CPU || opts.validate_cpu || opts.validate_precision) {
+        opts.headless = true;
+    }
+    if (opts.validate_precision && !opts.precision) {
+        opts.precision = State::World::REDUCED;
+    }
+    if (opts.validate_precision && opts.backend != Options::GPU) {
+        LOG_ERR("--validate-precision needs the GPU backend");
+        return std::nullopt;
+    }
+    if (opts.input && opts.backend != Options::CPU) {
+        LOG_ERR("--in needs the CPU backend");
+        return std::nullopt;
+    }
+    return opts;
+}
+
+static bool write_pfm(const std::string& path, u32 width, u32 height, const Vec<float>& pixels) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        LOG_ERR("FAILED TO WRITE TO FILE: {}", path);
+        return false;
+    }
+    defer { fclose(file); };
+    // negative scale = little endian, rows are stored bottom to top like GL textures
+    const auto header = fmt::format("Pf\n{} {}\n-1.0\n", width, height);
+    if (fwrite(header.data(), header.size(), 1, file) != 1 ||
+        fwrite(pixels.data(), pixels.size() * sizeof(float), 1, file) != 1
+    ) {
+        LOG_ERR("Failed to write the heightmap, path: {}", path);
+        return false;
+    }
+    return true;
+}
+
+bool Batch::export_heightmap(const State::World::Textures& world, const std::string& path) {
+    const auto& tex = world.heightmap.get_read_tex();
+    const size_t texels = size_t(tex.width) * tex.height;
+    Vec<float> pixels(texels * 4);
+    glGetTextureImage(
+        tex.texture, 0,
+        GL_RGBA, GL_FLOAT,
+        pixels.size() * sizeof(float), pixels.data()
+    );
+    // (rock, dirt, water, total) -> terrain height
+    Vec<float> terrain(texels);
+    for (size_t i = 0; i < texels; i++) {
+        terrain[i] = pixels[i * 4 + 0] + pixels[i * 4 + 1];
+    }
+    return write_pfm(path, tex.width, tex.height, terrain);
+}
+
+bool Batch::export_heightmap(const Erosion::Cpu_grid& grid, const std::string& path) {
+    Vec<float> terrain(grid.rock.size());
+    for (size_t i = 0; i < terrain.size(); i++) {
+        terrain[i] = grid.rock[i] + grid.dirt[i];
+    }
+    return write_pfm(path, grid.size, grid.size, terrain);
+}
+
+Opt<Erosion::Cpu_grid> Batch::import_heightmap(const std::string& path) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        LOG_ERR("FAILED TO OPEN FILE: {}", path);
+        return std::nullopt;
+    }
+    defer { fclose(file); };
+    char type[3] = {};
+    unsigned width, height;
+    float scale;
+    // a single whitespace character separates the header from the data
+    if (fscanf(file, "%2s %u %u %f", type, &width, &height, &scale) != 4 || fgetc(file) == EOF) {
+        LOG_ERR("Invalid PFM header, path: {}", path);
+        return std::nullopt;
+    }
+    const u32 channels = !strcmp(type, "Pf") ? 1 : !strcmp(type, "PF") ? 3 : 0;
+    if (channels == 0 || scale >= 0.f) {
+        LOG_ERR("Only little endian Pf/PF images are supported, path: {}", path);
+        return std::nullopt;
+    }
+    if (width != height || width < 2) {
+        LOG_ERR("The heightmap has to be square, got {}x{}, path: {}", width, height, path);
+        return std::nullopt;
+    }
+    Vec<float> pixels(size_t(width) * height * channels);
+    if (fread(pixels.data(), pixels.size() * sizeof(float), 1, file) != 1) {
+        LOG_ERR("Failed to read the heightmap, path: {}", path);
+        return std::nullopt;
+    }
+    auto grid = Erosion::gen_cpu_grid(width);
+    for (size_t i = 0; i < grid.rock.size(); i++) {
+        grid.rock[i] = pixels[i * channels];
+    }
+    return grid;
+}
+
+// initial terrain of a CPU run from the heightmap shader on a short lived context
+static bool gen_cpu_heightmap(const State::Settings& settings, u32 map_size, Erosion::Cpu_grid& grid) {
+    bool gl_error = false;
+    Uq_ptr<Headless_context, decltype(&destroy_headless)> context(
+        init_headless(&gl_error),
+        destroy_headless
+    );
+    if (context == nullptr) {
+        return false;
+    }
+    defer { Profiler::destroy(); };
+    auto gl_settings = State::setup_settings();
+    defer { State::delete_settings(gl_settings); };
+    gl_settings.map.data = settings.map.data;
+
+    State::World::Map_generator comput_map;
+    auto world_data = State::World::gen_textures(map_size, 0);
+    defer { delete_textures(world_data); };
+    State::World::gen_heightmap(gl_settings, world_data, comput_map);
+
+    grid = Erosion::gen_cpu_grid(map_size);
+    Erosion::download_grid(grid, world_data);
+    return !gl_error;
+}
+
+static int run_cpu(
+    const Batch::Options& opts,
+    Erosion::Programs::Erosion_type type,
+    u32 map_size,
+    u32 particle_count
+) {
+    const bool is_particle = type == Erosion::Programs::PARTICLES;
+    auto settings = State::default_settings(is_particle, particle_count);
+    if (opts.seed) {
+        settings.map.data.seed = *opts.seed;
+    }
+    Erosion::Cpu_grid grid;
+    if (opts.input) {
+        auto imported = Batch::import_heightmap(*opts.input);
+        if (!imported) {
+            return EXIT_FAILURE;
+        }
+        grid = std::move(*imported);
+    } else if (!gen_cpu_heightmap(settings, map_size, grid)) {
+        LOG_ERR("Failed to generate the initial heightmap.");
+        return EXIT_FAILURE;
+    }
+
+    Erosion::Cpu_particles parts;
+    if (is_particle) {
+        parts = Erosion::gen_cpu_particles(grid.size, particle_count);
+    }
+
+    Thread_pool pool(opts.threads);
+    LOG("CPU run: {} erosion, map size {}, {} steps, {} threads",
+        is_particle ? "particle" : "grid", grid.size, opts.steps, pool.size());
+
+    using Clock = std::chrono::steady_clock;
+    double total_ms = 0.0;
+    const u32 report_every = opts.steps >= 10 ? opts.steps / 10 : 1;
+    for (u32 step = 1; step <= opts.steps; step++) {
+        const auto start = Clock::now();
+        if (is_particle) {
+            Erosion::dispatch_particle(
+                grid, parts, settings.erosion.data, step * BATCH_STEP_TIME, true, pool
+            );
+        } else {
+            if (!(step % settings.rain.data.period)) {
+                Erosion::dispatch_grid_rain(
+                    grid, settings.rain.data, settings.map.data, step * BATCH_STEP_TIME, pool
+                );
+            }
+            Erosion::dispatch_grid(grid, settings.erosion.data, pool);
+        }
+        total_ms += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        if (!(step % report_every)) {
+            LOG("Step {}/{}, CPU step time: {:.3f} ms", step, opts.steps, total_ms / step);
+        }
+    }
+
+    if (!Batch::export_heightmap(grid, opts.output)) {
+        return EXIT_FAILURE;
+    }
+    LOG("Heightmap written to {}", opts.output);
+    return EXIT_SUCCESS;
+}
+
+// logs the terrain and water difference of two grids, false if the terrain
+// differs by more than the tolerance
+static bool compare_grids(
+    const Erosion::Cpu_grid& a,
+    const Erosion::Cpu_grid& b,
+    const char* label,
+    float tolerance
+) {
+    float max_terrain = 0.f;
+    float max_water = 0.f;
+    double sum_terrain = 0.0;
+    double sum_water = 0.0;
+    for (size_t i = 0; i < a.rock.size(); i++) {
+        const float terrain = std::abs(
+            (a.rock[i] + a.dirt[i]) - (b.rock[i] + b.dirt[i])
+        );
+        const float water = std::abs(a.water[i] - b.water[i]);
+        // NaN has to fail the comparison too
+        max_terrain = !(terrain <= max_terrain) ? terrain : max_terrain;
+        max_water = !(water <= max_water) ? water : max_water;
+        sum_terrain += terrain;
+        sum_water += water;
+    }
+    LOG("{}: terrain max diff {:.6f}, mean diff {:.6f}, water max diff {:.6f}, mean diff {:.6f}",
+        label, max_terrain, sum_terrain / a.rock.size(), max_water, sum_water / a.rock.size());
+    if (!(max_terrain <= tolerance)) {
+        LOG_ERR("{}: the terrain differs by more than {}", label, tolerance);
+        return false;
+    }
+    return true;
+}
+
+// compares the CPU grid with the GPU textures after the same steps
+static bool validate_cpu_grid(
+    const Erosion::Cpu_grid& cpu,
+    const State::World::Textures& world,
+    float tolerance
+) {
+    auto gpu = Erosion::gen_cpu_grid(cpu.size);
+    Erosion::download_grid(gpu, world);
+    return compare_grids(cpu, gpu, "CPU vs GPU", tolerance);
+}
+
+// compares the reduced precision textures with the full precision reference
+static bool validate_precision(
+    const State::World::Textures& reference,
+    const State::World::Textures& world,
+    float tolerance
+) {
+    auto full = Erosion::gen_cpu_grid(reference.map_size);
+    auto reduced = Erosion::gen_cpu_grid(world.map_size);
+    Erosion::download_grid(full, reference);
+    Erosion::download_grid(reduced, world);
+    return compare_grids(full, reduced, "Full vs reduced precision", tolerance);
+}
+
+int Batch::run(const Options& opts, const Config& config) {
+    // GPU droplets race on the lockmap, there is nothing to compare against
+    if (opts.validate_cpu && config.type != Erosion::Programs::GRID) {
+        LOG_ERR("--validate-cpu only supports grid erosion.");
+        return EXIT_FAILURE;
+    }
+    if (opts.validate_precision && config.type != Erosion::Programs::GRID) {
+        LOG_ERR("--validate-precision only supports grid erosion.");
+        return EXIT_FAILURE;
+    }
+    if (opts.validate_precision && config.precision != State::World::REDUCED) {
+        LOG_ERR("--validate-precision needs the reduced precision.");
+        return EXIT_FAILURE;
+    }
+    // both sides of a validation have to advance by the same d_t
+    if ((opts.validate_cpu || opts.validate_precision) && config.adaptive_period) {
+        LOG_ERR("The validations need a fixed time step.");
+        return EXIT_FAILURE;
+    }
+    // the CPU grid only has the pipe model
+    if (opts.validate_cpu && config.multigrid_period) {
+        LOG_ERR("--validate-cpu can't follow the multigrid water, run it without --multigrid.");
+        return EXIT_FAILURE;
+    }
+    // the CPU grid evaluates the rain noise
+    if (opts.validate_cpu && config.cached_rain) {
+        LOG_ERR("--validate-cpu needs the rain noise, run it with --rain noise.");
+        return EXIT_FAILURE;
+    }
+    if (opts.backend == Options::CPU) {
+        return run_cpu(opts, config.type, config.map_size, config.particle_count);
+    }
+    bool gl_error = false;
+    Uq_ptr<Headless_context, decltype(&destroy_headless)> context(
+        init_headless(&gl_error),
+        destroy_headless
+    );
+    if (context == nullptr) {
+        return EXIT_FAILURE;
+    }
+    LOG("Headless run: {} erosion, map size {}, {} steps",
+        config.type == Erosion::Programs::GRID ? "grid" : "particle",
+        config.map_size,
+        opts.steps);
+
+    auto settings = State::setup_settings(
+        config.type == Erosion::Programs::PARTICLES,
+        config.particle_count
+    );
+    defer{ State::delete_settings(settings); };
+    if (opts.seed) {
+        settings.map.data.seed = *opts.seed;
+    }
+
+    State::World::Map_generator comput_map(State::World::shader_defines(config.precision));
+    State::World::Textures world_data = 
+        State::World::gen_textures(
+            config.map_size, config.particle_count, config.precision, config.deposition
+        );
+    defer{ delete_textures(world_data); };
+
+    State::World::gen_heightmap(settings, world_data, comput_map);
+    Uq_ptr<Erosion::Programs> erosion_progs_ptr(
+        Erosion::setup_shaders(config.type, settings, world_data, config.particle_count)
+    );
+    auto& erosion_progs = *erosion_progs_ptr.get();
+    defer { Profiler::destroy(); };
+    if (erosion_progs.grid != nullptr) {
+        erosion_progs.grid->fused = config.fused_grid;
+        erosion_progs.grid->adaptive_period = config.adaptive_period;
+        erosion_progs.grid->sparse = config.sparse_grid && config.fused_grid;
+        LOG("Grid kernel: {}{}",
+            config.fused_grid ? "fused flux + erosion" : "separate passes",
+            erosion_progs.grid->sparse ? ", active tiles only" : "");
+        if (config.sparse_grid && !config.fused_grid) {
+            LOG("Sparse tiles need the fused kernel, running the whole map.");
+        }
+        erosion_progs.grid->multigrid_period = config.multigrid_period;
+        erosion_progs.grid->cached_rain = config.cached_rain;
+        if (config.cached_rain) {
+            LOG("Rain from {} cached noise patterns", RAIN_PATTERNS);
+        }
+        if (config.multigrid_period) {
+            u32 levels = 0;
+            while (levels < State::World::WATER_LEVELS && world_data.water_level_sizes[levels]) {
+                levels++;
+            }
+            LOG("Multigrid water every {} steps, {} levels down to {}",
+                config.multigrid_period, levels, levels ? world_data.water_level_sizes[levels - 1] : config.map_size);
+        }
+        if (config.adaptive_period) {
+            LOG("Adaptive time step every {} steps, courant number {}, d_t in [{}, {}]",
+                config.adaptive_period,
+                settings.erosion.data.courant,
+                settings.erosion.data.d_t_min,
+                settings.erosion.data.d_t_max);
+        }
+    }
+    if (erosion_progs.particle != nullptr) {
+        erosion_progs.particle->sort_period = config.sort_period;
+        LOG("Particle deposition: {}",
+            config.deposition == State::World::ATOMIC ? "atomic fixed point deltas" : "texel locks");
+        if (config.sort_period) {
+            LOG("Droplets sorted by map tile every {} steps", config.sort_period);
+        }
+        erosion_progs.particle->substeps = config.substeps;
+        if (config.substeps > 1) {
+            LOG("{} droplet steps per step, {} in total", config.substeps, u64(config.substeps) * opts.steps);
+        }
+        erosion_progs.particle->compact_live = config.compact_particles;
+        if (config.compact_particles) {
+            LOG("Dry steps dispatched over the live droplets only");
+        }
+    }
+    LOG("Field storage: {} precision, {:.1f} MiB of textures",
+        config.precision == State::World::REDUCED ? "reduced" : "full",
+        State::World::texture_bytes(
+            config.map_size, config.particle_count, config.precision, config.deposition
+        ) / (1024.0 * 1024.0));
+
+    // full precision grid on the same terrain, follows every step of the reduced one
+    Opt<State::World::Map_generator> reference_map;
+    Opt<State::World::Textures> reference;
+    Uq_ptr<Erosion::Programs> reference_progs;
+    defer {
+        if (reference) {
+            delete_textures(*reference);
+        }
+    };
+    if (opts.validate_precision) {
+        reference_map.emplace();
+        reference = State::World::gen_textures(config.map_size, config.particle_count);
+        // clears the other fields, the heightmap is copied since the shader
+        // output isn't bit exact between dispatches on every driver
+        State::World::gen_heightmap(settings, *reference, *reference_map);
+        const auto& src = world_data.heightmap.get_read_tex();
+        glCopyImageSubData(
+            src.texture, src.target, 0, 0, 0, 0,
+            reference->heightmap.get_read_tex().texture, src.target, 0, 0, 0, 0,
+            src.width, src.height, 1
+        );
+        reference_progs.reset(
+            Erosion::setup_shaders(config.type, settings, *reference, config.particle_count)
+        );
+        reference_progs->grid->fused = config.fused_grid;
+        reference_progs->grid->sparse = erosion_progs.grid->sparse;
+        reference_progs->grid->multigrid_period = config.multigrid_period;
+        reference_progs->grid->cached_rain = config.cached_rain;
+        LOG("Validating against a full precision grid");
+    }
+
+    // the CPU grid starts from the same terrain and follows every GPU step
+    Opt<Erosion::Cpu_grid> cpu_grid;
+    Uq_ptr<Thread_pool> pool;
+    if (opts.validate_cpu) {
+        cpu_grid = Erosion::gen_cpu_grid(config.map_size);
+        Erosion::download_grid(*cpu_grid, world_data);
+        pool = std::make_unique<Thread_pool>(opts.threads);
+        LOG("Validating against the CPU grid, {} threads", pool->size());
+    }
+
+    // the steps up to the next progress report go out as one batch
+    const u32 report_every = opts.steps >= 10 ? opts.steps / 10 : 1;
+    const u32 rain_steps = opts.rain_steps.value_or(opts.steps);
+    if (rain_steps < opts.steps) {
+        LOG("Rain stops after step {}", rain_steps);
+    }
+    for (u32 step = 1; step <= opts.steps && !gl_error;) {
+        u32 count = std::min<u32>(
+            report_every - (step - 1) % report_every,
+            opts.steps - step + 1
+        );
+        // a batch is either wet or dry
+        if (step <= rain_steps) {
+            count = std::min<u32>(count, rain_steps - step + 1);
+        }
+        const Erosion::Steps steps {
+            .first          = step,
+            .count          = count,
+            .rain_period    = u32(settings.rain.data.period),
+            .should_rain    = step <= rain_steps,
+            .time_step      = BATCH_STEP_TIME
+        };
+        const float start = step * BATCH_STEP_TIME;
+        world_data.time = start;
+        Erosion::step(erosion_progs, world_data, steps);
+        if (reference) {
+            reference->time = start;
+            Erosion::step(*reference_progs, *reference, steps);
+        }
+        // same clock as Erosion::step
+        for (u32 i = 0; cpu_grid && i < count; i++) {
+            if (steps.should_rain && !((step + i) % settings.rain.data.period)) {
+                Erosion::dispatch_grid_rain(
+                    *cpu_grid, settings.rain.data, settings.map.data,
+                    start + i * BATCH_STEP_TIME, *pool
+                );
+            }
+            Erosion::dispatch_grid(*cpu_grid, settings.erosion.data, *pool);
+        }
+        step += count;
+        Profiler::collect();
+        if (!((step - 1) % report_every)) {
+            LOG("Step {}/{}, GPU step time: {:.3f} ms", 
+                step - 1, opts.steps, Profiler::erosion_step_ms());
+            // waits for the last step, only at the reports
+            if (erosion_progs.grid != nullptr && erosion_progs.grid->sparse) {
+                GLuint listed = 0;
+                glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+                glGetNamedBufferSubData(world_data.tile_list.bo, 0, sizeof(listed), &listed);
+                LOG("Active tiles: {}/{}",
+                    listed, (config.map_size / WRKGRP_SIZE_X) * (config.map_size / WRKGRP_SIZE_Y));
+            }
+            if (erosion_progs.particle != nullptr && erosion_progs.particle->use_live_list) {
+                GLuint live = 0;
+                glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+                glGetNamedBufferSubData(
+                    world_data.particle_live.bo, 3 * sizeof(GLuint), sizeof(live), &live
+                );
+                LOG("Live droplets: {}/{}", live, config.particle_count);
+            }
+            // a few steps behind, nothing waits for the GPU
+            if (config.adaptive_period && config.type == Erosion::Programs::GRID) {
+                LOG("Time step: {:.5f}, simulated time: {:.3f}",
+                    world_data.step->d_t, world_data.step->time);
+            }
+        }
+    }
+    if (gl_error) {
+        LOG_ERR("OpenGL error, aborting the batch run.");
+        return EXIT_FAILURE;
+    }
+    glFinish();
+    Profiler::collect();
+    for (u32 pass = 0; pass < Profiler::PASS_COUNT; pass++) {
+        if (Profiler::sample_count(pass) > 0) {
+            LOG("{:>28}: {:.3f} ms", Profiler::pass_name(pass), Profiler::mean_ms(pass));
+        }
+    }
+    if (config.adaptive_period && config.type == Erosion::Programs::GRID) {
+        LOG("Simulated time: {:.3f} in {} time step updates, fixed d_t would reach {:.3f}",
+            world_data.step->time,
+            world_data.step->updates,
+            opts.steps * settings.erosion.data.d_t);
+    }
+    if (opts.timings && !Profiler::write_csv(*opts.timings)) {
+        return EXIT_FAILURE;
+    }
+
+    if (!export_heightmap(world_data, opts.output)) {
+        return EXIT_FAILURE;
+    }
+    LOG("Heightmap written to {}", opts.output);
+    if (cpu_grid && !validate_cpu_grid(*cpu_grid, world_data, opts.tolerance.value_or(CPU_TOLERANCE))) {
+        return EXIT_FAILURE;
+    }
+    if (reference && !validate_precision(*reference, world_data, opts.tolerance.value_or(PRECISION_TOLERANCE))) {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
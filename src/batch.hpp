@@ -0,0 +1,97 @@
+#ifndef HYDR_BATCH_HPP
+#define HYDR_BATCH_HPP
+
+#include <string>
+#include "erosion.hpp"
+#include "cpu_grid.hpp"
+#include "cpu_particles.hpp"
+#include "state.hpp"
+
+// headless runs: N erosion steps on an offscreen context, export and exit
+namespace Batch {
+
+struct Options {
+    enum Backend {
+        GPU,
+        CPU
+    };
+
+    bool headless = false;
+    u32 steps = 10000;
+    std::string output = "heightmap.pfm";
+    // per-pass GPU times, CSV
+    Opt<std::string> timings;
+    // it only rains in the first N steps of GPU runs, all of them by default
+    Opt<u32> rain_steps;
+
+    Backend backend = GPU;
+    // CPU worker threads, 0 = all hardware threads
+    u32 threads = 0;
+    // initial terrain for the CPU backend instead of the heightmap shader
+    Opt<std::string> input;
+    // runs the GPU and CPU grid side by side and compares the results
+    bool validate_cpu = false;
+    // runs a full precision copy of the GPU grid next to the reduced one
+    bool validate_precision = false;
+    // max. allowed terrain height difference for the validation, each validation
+    // has its own default
+    Opt<float> tolerance;
+
+    // overrides for the config.ini values
+    Opt<u32> map_size;
+    Opt<u32> particle_count;
+    Opt<Erosion::Programs::Erosion_type> type;
+    Opt<bool> fused_grid;
+    Opt<State::World::Precision> precision;
+    // grid steps between adaptive time step updates, 0 = fixed d_t
+    Opt<u32> adaptive_period;
+    // fused grid kernel over the tiles near water only
+    Opt<bool> sparse_grid;
+    // grid steps between multigrid water cycles, 0 = never
+    Opt<u32> multigrid_period;
+    // grid rain looked up in cached noise patterns
+    Opt<bool> cached_rain;
+    Opt<State::World::Deposition> deposition;
+    // particle steps between droplet sorts, 0 = never
+    Opt<u32> sort_period;
+    // droplet steps per particle erosion step
+    Opt<u32> substeps;
+    // droplet passes over the live droplets only while it doesn't rain
+    Opt<bool> compact_particles;
+    Opt<float> seed;
+};
+
+// returns nullopt when the arguments are invalid
+Opt<Options> parse_args(int argc, char* argv[]);
+void print_usage(const char* program_name);
+
+// the erosion setup of a run, the overrides of Options resolved against
+// config.ini once, the interactive mode starts from it too
+struct Config {
+    Erosion::Programs::Erosion_type type = Erosion::Programs::GRID;
+    u32 map_size = 1024;
+    // 0 for grid erosion
+    u32 particle_count = 0;
+    bool fused_grid = true;
+    State::World::Precision precision = State::World::FULL;
+    u32 adaptive_period = 0;
+    bool sparse_grid = false;
+    u32 multigrid_period = 0;
+    bool cached_rain = false;
+    State::World::Deposition deposition = State::World::LOCKED;
+    u32 sort_period = 0;
+    u32 substeps = 1;
+    bool compact_particles = false;
+};
+
+int run(const Options& opts, const Config& config);
+
+// writes terrain height (rock + dirt) as a greyscale PFM image
+bool export_heightmap(const State::World::Textures& world, const std::string& path);
+bool export_heightmap(const Erosion::Cpu_grid& grid, const std::string& path);
+
+// reads a square greyscale PFM image into the rock layer of a new CPU grid
+Opt<Erosion::Cpu_grid> import_heightmap(const std::string& path);
+
+};
+#endif // HYDR_BATCH_HPP
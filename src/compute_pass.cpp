@@ -0,0 +1,199 @@
+#include "compute_pass.hpp"
+#include "profiler.hpp"
+#include "settings.hpp"
+
+Compute_pass::Compute_pass(
+    Compute_program& program,
+    u32 profiler_pass,
+    const u32& size,
+    Shape shape
+) :
+    program(&program),
+    profiler_pass(profiler_pass),
+    shape(shape),
+    size(&size)
+{
+    if (shape == PARTICLES) {
+        barriers |= GL_SHADER_STORAGE_BARRIER_BIT;
+    }
+}
+
+static GLbitfield barrier_bit(bool image) {
+    return image ? GL_SHADER_IMAGE_ACCESS_BARRIER_BIT : GL_TEXTURE_FETCH_BARRIER_BIT;
+}
+
+Compute_pass& Compute_pass::texture(const char* var, const gl::Texture& tex) {
+    bindings.push_back({
+        .unit = program->binding_unit(var),
+        .image = false,
+        .tex = &tex,
+        .pair = nullptr,
+        .slot = READ
+    });
+    barriers |= barrier_bit(bindings.back().image);
+    return *this;
+}
+
+Compute_pass& Compute_pass::texture(const char* var, const gl::Tex_pair& pair, Slot slot) {
+    bindings.push_back({
+        .unit = program->binding_unit(var),
+        .image = false,
+        .tex = nullptr,
+        .pair = &pair,
+        .slot = slot
+    });
+    barriers |= barrier_bit(bindings.back().image);
+    return *this;
+}
+
+Compute_pass& Compute_pass::image(const char* var, const gl::Texture& tex) {
+    bindings.push_back({
+        .unit = program->binding_unit(var),
+        .image = true,
+        .tex = &tex,
+        .pair = nullptr,
+        .slot = READ
+    });
+    barriers |= barrier_bit(bindings.back().image);
+    return *this;
+}
+
+Compute_pass& Compute_pass::image(const char* var, const gl::Tex_pair& pair, Slot slot) {
+    bindings.push_back({
+        .unit = program->binding_unit(var),
+        .image = true,
+        .tex = nullptr,
+        .pair = &pair,
+        .slot = slot
+    });
+    barriers |= barrier_bit(bindings.back().image);
+    return *this;
+}
+
+Compute_pass& Compute_pass::unbind_image(const char* var) {
+    bindings.push_back({
+        .unit = program->binding_unit(var),
+        .image = true,
+        .tex = nullptr,
+        .pair = nullptr,
+        .slot = READ
+    });
+    barriers |= barrier_bit(bindings.back().image);
+    return *this;
+}
+
+Compute_pass& Compute_pass::uniform(const char* var, const float& value) {
+    uniforms.push_back({
+        .location = program->uniform_location(var),
+        .value = &value,
+        .flag = nullptr,
+        .count = nullptr
+    });
+    return *this;
+}
+
+Compute_pass& Compute_pass::uniform(const char* var, const bool& flag) {
+    uniforms.push_back({
+        .location = program->uniform_location(var),
+        .value = nullptr,
+        .flag = &flag,
+        .count = nullptr
+    });
+    return *this;
+}
+
+Compute_pass& Compute_pass::uniform(const char* var, const u32& count) {
+    uniforms.push_back({
+        .location = program->uniform_location(var),
+        .value = nullptr,
+        .flag = nullptr,
+        .count = &count
+    });
+    return *this;
+}
+
+Compute_pass& Compute_pass::indirect_from(const gl::Buffer& args, const bool& enabled) {
+    indirect = &args;
+    use_indirect = &enabled;
+    return *this;
+}
+
+Compute_pass& Compute_pass::barrier(GLbitfield bits) {
+    barriers |= bits;
+    return *this;
+}
+
+Compute_pass& Compute_pass::swap(gl::Tex_pair& pair, bool read_write) {
+    swaps.push_back({
+        .pair = &pair,
+        .read_write = read_write
+    });
+    return *this;
+}
+
+void Compute_pass::dispatch() {
+    program->use();
+    for (const auto& u : uniforms) {
+        if (u.value != nullptr) {
+            glUniform1f(u.location, *u.value);
+        } else if (u.flag != nullptr) {
+            glUniform1i(u.location, *u.flag);
+        } else {
+            glUniform1ui(u.location, GLuint(*u.count));
+        }
+    }
+    for (const auto& b : bindings) {
+        const gl::Texture* tex = b.tex;
+        if (b.pair != nullptr) {
+            tex = b.slot == READ ? &b.pair->get_read_tex() : &b.pair->get_write_tex();
+        }
+        if (!b.image) {
+            glBindTextureUnit(b.unit, tex->texture);
+        } else if (tex == nullptr) {
+            glBindImageTexture(b.unit, 0, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+        } else {
+            glBindImageTexture(
+                b.unit,
+                tex->texture,
+                tex->level,
+                tex->layered,
+                tex->layer,
+                tex->access,
+                tex->format
+            );
+        }
+    }
+    const bool is_indirect = indirect != nullptr && *use_indirect;
+    if (is_indirect) {
+        // the arguments and whatever else the pass reads from the buffer
+        glMemoryBarrier(barriers | GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+    } else {
+        glMemoryBarrier(barriers);
+    }
+    Profiler::begin(profiler_pass);
+    if (is_indirect) {
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, indirect->bo);
+        glDispatchComputeIndirect(0);
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+    } else if (shape == MAP) {
+        glDispatchCompute(*size / WRKGRP_SIZE_X, *size / WRKGRP_SIZE_Y, 1);
+    } else if (shape == PARTICLES) {
+        glDispatchCompute(*size / (WRKGRP_SIZE_X * WRKGRP_SIZE_Y), 1, 1);
+    } else if (shape == TILES) {
+        constexpr u32 group = WRKGRP_SIZE_X * WRKGRP_SIZE_Y;
+        const u32 tiles = (*size / WRKGRP_SIZE_X) * (*size / WRKGRP_SIZE_Y);
+        glDispatchCompute((tiles + group - 1) / group, 1, 1);
+    } else {
+        glDispatchCompute(1, 1, 1);
+    }
+    Profiler::end(profiler_pass);
+    for (const auto& s : swaps) {
+        s.pair->swap(s.read_write);
+    }
+}
+
+void dispatch(Vec<Compute_pass>& passes) {
+    for (auto& pass : passes) {
+        pass.dispatch();
+    }
+}
@@ -0,0 +1,90 @@
+#ifndef HYDR_COMPUTE_PASS_HPP
+#define HYDR_COMPUTE_PASS_HPP
+
+#include "shaderprogram.hpp"
+
+// one dispatch of a Compute_program with its bindings resolved up front: names
+// are looked up once while the pass is built, a dispatch only binds by unit
+// from the table, no hashing or glGetUniformiv round trips every step
+struct Compute_pass {
+    // dispatched over a size x size map, over `size` particles, once per
+    // workgroup sized tile of the map or as a single invocation for
+    // bookkeeping between passes
+    enum Shape : u8 {
+        MAP,
+        PARTICLES,
+        TILES,
+        SINGLE
+    };
+    // texture of a pair, picked at dispatch time since pairs swap every step
+    enum Slot : u8 {
+        READ,
+        WRITE
+    };
+    struct Binding {
+        GLuint unit;
+        bool image;
+        // tex or pair, neither unbinds the unit
+        const gl::Texture* tex;
+        const gl::Tex_pair* pair;
+        Slot slot;
+    };
+    struct Uniform {
+        GLint location;
+        // value, flag or count
+        const float* value;
+        const bool* flag;
+        const u32* count;
+    };
+    struct Swap {
+        gl::Tex_pair* pair;
+        bool read_write;
+    };
+
+    Compute_program* program;
+    u32 profiler_pass;
+    Shape shape;
+    // read at dispatch time, the map can be regenerated with another size
+    const u32* size;
+    // issued before the dispatch, makes the writes of earlier passes visible
+    // to the kinds of access this pass does, follows from its bindings
+    GLbitfield barriers = 0;
+    // dispatch size read from the buffer written by an earlier pass instead,
+    // while the flag is set
+    const gl::Buffer* indirect = nullptr;
+    const bool* use_indirect = nullptr;
+
+    Vec<Binding> bindings;
+    Vec<Uniform> uniforms;
+    Vec<Swap> swaps;
+
+    Compute_pass(
+        Compute_program& program,
+        u32 profiler_pass,
+        const u32& size,
+        Shape shape = MAP
+    );
+
+    Compute_pass& texture(const char* var, const gl::Texture& tex);
+    Compute_pass& texture(const char* var, const gl::Tex_pair& pair, Slot slot = READ);
+    Compute_pass& image(const char* var, const gl::Texture& tex);
+    Compute_pass& image(const char* var, const gl::Tex_pair& pair, Slot slot);
+    Compute_pass& unbind_image(const char* var);
+    // the referenced values are read on every dispatch
+    Compute_pass& uniform(const char* var, const float& value);
+    Compute_pass& uniform(const char* var, const bool& flag);
+    Compute_pass& uniform(const char* var, const u32& count);
+    Compute_pass& indirect_from(const gl::Buffer& args, const bool& enabled);
+    // accesses the bindings don't show, e.g. storage buffers written by an earlier pass
+    Compute_pass& barrier(GLbitfield bits);
+    // swapped after the dispatch
+    Compute_pass& swap(gl::Tex_pair& pair, bool read_write = false);
+
+    void dispatch();
+};
+
+// dispatches the passes in order, nothing waits on the last one: whatever
+// reads the results afterwards needs its own barrier
+void dispatch(Vec<Compute_pass>& passes);
+
+#endif // HYDR_COMPUTE_PASS_HPP
@@ -0,0 +1,756 @@
+#include "cpu_grid.hpp"
+#include <cmath>
+#include <numbers>
+using namespace Erosion;
+
+// every pass is a loop over rows, the interior of a row has no bounds checks
+// so it vectorizes, GCC/clang build AVX-512, AVX2 and baseline versions and
+// pick one at load time
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__) && !defined(_WIN32)
+#define HYDR_SIMD_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define HYDR_SIMD_CLONES
+#endif
+
+// the cell functions have to end up inside the row loops to vectorize
+#if defined(__GNUC__) || defined(__clang__)
+#define HYDR_INLINE inline __attribute__((always_inline))
+#define HYDR_INLINE_LAMBDA __attribute__((always_inline))
+#else
+#define HYDR_INLINE inline
+#define HYDR_INLINE_LAMBDA
+#endif
+
+#if defined(__clang__)
+#define HYDR_IVDEP _Pragma("clang loop vectorize(assume_safety)")
+#elif defined(__GNUC__)
+#define HYDR_IVDEP _Pragma("GCC ivdep")
+#else
+#define HYDR_IVDEP
+#endif
+
+static_assert(SED_LAYERS == 2, "CPU grid stores the rock and dirt layers separately");
+
+// rows per work item
+constexpr u32 ROW_TILE = 16;
+
+// the shaders see everything outside the map as an infinitely high wall
+constexpr float OUT_OF_MAP_HEIGHT = 999999999999.f;
+// pipe length and cross-section area, L is only defined for GLSL in bindings.glsl
+constexpr float L = 1.f;
+constexpr float A = 1.f;
+
+namespace {
+
+// raw pointers of all fields for the duration of one pass
+struct View {
+    i32 n;
+    float* rock;
+    float* dirt;
+    float* water;
+    float* out_rock;
+    float* out_dirt;
+    float* out_water;
+    float* flux[4];
+    float* out_flux[4];
+    float* vel_u;
+    float* vel_v;
+    float* depth;
+    float* sediment[SED_LAYERS];
+    float* out_sediment[SED_LAYERS];
+    float* thermal[8 * SED_LAYERS];
+
+    size_t at(i32 x, i32 y) const {
+        return size_t(y) * n + x;
+    }
+    bool outside(i32 x, i32 y) const {
+        return x < 0 || y < 0 || x >= n || y >= n;
+    }
+};
+
+View view(Cpu_grid& grid) {
+    View v {
+        .n          = i32(grid.size),
+        .rock       = grid.rock.data(),
+        .dirt       = grid.dirt.data(),
+        .water      = grid.water.data(),
+        .out_rock   = grid.out_rock.data(),
+        .out_dirt   = grid.out_dirt.data(),
+        .out_water  = grid.out_water.data(),
+        .vel_u      = grid.vel_u.data(),
+        .vel_v      = grid.vel_v.data(),
+        .depth      = grid.depth.data(),
+    };
+    for (u32 i = 0; i < 4; i++) {
+        v.flux[i] = grid.flux[i].data();
+        v.out_flux[i] = grid.out_flux[i].data();
+    }
+    for (u32 i = 0; i < SED_LAYERS; i++) {
+        v.sediment[i] = grid.sediment[i].data();
+        v.out_sediment[i] = grid.out_sediment[i].data();
+    }
+    for (u32 i = 0; i < 8 * SED_LAYERS; i++) {
+        v.thermal[i] = grid.thermal[i].data();
+    }
+    return v;
+}
+
+// runs cell<EDGE>(x, y) over rows [begin, end), bounds checks only on the border
+template <typename F>
+HYDR_INLINE void for_rows(View v, u32 begin, u32 end, F&& cell) {
+    for (i32 y = begin; y < i32(end); y++) {
+        if (y == 0 || y == v.n - 1) {
+            for (i32 x = 0; x < v.n; x++) {
+                cell.template operator()<true>(x, y);
+            }
+            continue;
+        }
+        cell.template operator()<true>(0, y);
+        HYDR_IVDEP
+        for (i32 x = 1; x < v.n - 1; x++) {
+            cell.template operator()<false>(x, y);
+        }
+        cell.template operator()<true>(v.n - 1, y);
+    }
+}
+
+HYDR_INLINE float lerp(float a, float b, float t) {
+    // same operation order as GLSL mix()
+    return a * (1.f - t) + b * t;
+}
+
+// ------------------------------ rain ---------------------------------
+// gln_simplex and gln_sfbm from simplex_noise.glsl
+
+HYDR_INLINE float glsl_mod(float x, float y) {
+    return x - y * std::floor(x / y);
+}
+
+HYDR_INLINE float glsl_fract(float x) {
+    return x - std::floor(x);
+}
+
+HYDR_INLINE float rand_289(float p) {
+    return glsl_mod(((p * 34.f) + 1.f) * p, 289.f);
+}
+
+float simplex(float vx, float vy) {
+    constexpr float C[4] = {
+        0.211324865405187f, 0.366025403784439f, -0.577350269189626f, 0.024390243902439f
+    };
+    const float skew = vx * C[1] + vy * C[1];
+    float ix = std::floor(vx + skew);
+    float iy = std::floor(vy + skew);
+    const float unskew = ix * C[0] + iy * C[0];
+    const float x0[2] = { vx - ix + unskew, vy - iy + unskew };
+    const float i1[2] = { x0[0] > x0[1] ? 1.f : 0.f, x0[0] > x0[1] ? 0.f : 1.f };
+    const float corner[3][2] = {
+        { x0[0], x0[1] },
+        { x0[0] + C[0] - i1[0], x0[1] + C[0] - i1[1] },
+        { x0[0] + C[2], x0[1] + C[2] },
+    };
+    ix = glsl_mod(ix, 289.f);
+    iy = glsl_mod(iy, 289.f);
+    const float off_x[3] = { 0.f, i1[0], 1.f };
+    const float off_y[3] = { 0.f, i1[1], 1.f };
+
+    float result = 0.f;
+    for (u32 i = 0; i < 3; i++) {
+        const float p = rand_289(rand_289(iy + off_y[i]) + ix + off_x[i]);
+        float m = std::max(0.5f - (
+            corner[i][0] * corner[i][0] + corner[i][1] * corner[i][1]), 0.f);
+        m = m * m;
+        m = m * m;
+        const float x = 2.f * glsl_fract(p * C[3]) - 1.f;
+        const float h = std::abs(x) - 0.5f;
+        const float a0 = x - std::floor(x + 0.5f);
+        m *= 1.79284291400159f - 0.85373472095314f * (a0 * a0 + h * h);
+        result += m * (a0 * corner[i][0] + h * corner[i][1]);
+    }
+    return 130.f * result;
+}
+
+// options of the rain shader: persistance 0.5, lacunarity 2, 8 octaves
+float rain_fbm(float x, float y, float seed, float scale) {
+    x += seed * 100.f;
+    y += seed * 100.f;
+    float result = 0.f;
+    float amplitude = 1.f;
+    float frequency = 1.f;
+    float maximum = amplitude;
+    for (u32 i = 0; i < 8; i++) {
+        result += simplex(x * frequency * scale, y * frequency * scale) * amplitude;
+        frequency *= 2.f;
+        amplitude *= 0.5f;
+        maximum += amplitude;
+    }
+    return result / maximum;
+}
+
+HYDR_SIMD_CLONES
+void rain_rows(
+    View v,
+    const Rain_data& rain,
+    const Map_settings_data& map,
+    float seed,
+    u32 begin,
+    u32 end
+) {
+    const float thresh = map.max_height * rain.mountain_thresh;
+    const float mountain_div = (1.f - rain.mountain_thresh) * map.max_height;
+    for (i32 y = begin; y < i32(end); y++) {
+        for (i32 x = 0; x < v.n; x++) {
+            const size_t i = v.at(x, y);
+            const float r = std::max(0.f, rain_fbm(x, y, seed, rain.drops));
+            float incr = rain.amount * r;
+            const float mountain = v.rock[i] + v.dirt[i] + v.water[i] - thresh;
+            if (mountain > 0) {
+                incr += mountain * rain.mountain_multip * r / mountain_div;
+            }
+            v.water[i] += incr;
+        }
+    }
+}
+
+// ------------------------------ flux ---------------------------------
+// hydro_flux.glsl, new water height and velocity from the pipe model
+
+template <bool EDGE>
+HYDR_INLINE float total_height(const View& v, i32 x, i32 y) {
+    if constexpr (EDGE) {
+        if (v.outside(x, y)) {
+            return OUT_OF_MAP_HEIGHT;
+        }
+    }
+    const size_t i = v.at(x, y);
+    return v.rock[i] + v.dirt[i] + v.water[i];
+}
+
+template <bool EDGE>
+HYDR_INLINE float flux_at(const View& v, u32 dir, i32 x, i32 y) {
+    if constexpr (EDGE) {
+        if (v.outside(x, y)) {
+            return 0.f;
+        }
+    }
+    return v.flux[dir][v.at(x, y)];
+}
+
+template <bool EDGE>
+HYDR_INLINE void flux_cell(const View& v, const Erosion_data& set, i32 x, i32 y) {
+    const size_t i = v.at(x, y);
+    const float d1 = v.water[i];
+    const float height = v.rock[i] + v.dirt[i] + d1;
+
+    const float d_height[4] = {
+        height - total_height<EDGE>(v, x - 1, y),
+        height - total_height<EDGE>(v, x + 1, y),
+        height - total_height<EDGE>(v, x, y + 1),
+        height - total_height<EDGE>(v, x, y - 1),
+    };
+    const float from_left   = flux_at<EDGE>(v, RIGHT, x - 1, y);
+    const float from_right  = flux_at<EDGE>(v, LEFT, x + 1, y);
+    const float from_top    = flux_at<EDGE>(v, BOTTOM, x, y + 1);
+    const float from_bottom = flux_at<EDGE>(v, TOP, x, y - 1);
+    const float sum_in = from_left + from_right + from_top + from_bottom;
+
+    float out[4];
+    for (u32 d = 0; d < 4; d++) {
+        out[d] = std::max(0.f,
+            set.ENERGY_KEPT * v.flux[d][i] + set.d_t * A * (set.G * d_height[d]) / L);
+    }
+    if constexpr (EDGE) {
+        if (x <= 0) {
+            out[LEFT] = 0;
+        } else if (x >= v.n - 1) {
+            out[RIGHT] = 0;
+        }
+        if (y <= 0) {
+            out[BOTTOM] = 0;
+        } else if (y >= v.n - 1) {
+            out[TOP] = 0;
+        }
+    }
+    float sum_out = out[LEFT] + out[RIGHT] + out[TOP] + out[BOTTOM];
+
+    // scaling factor, min() picks 1 for 0/0 like GLSL
+    const float K = std::min(1.f, (d1 * L * L) / (sum_out * set.d_t));
+    for (u32 d = 0; d < 4; d++) {
+        out[d] *= K;
+        v.out_flux[d][i] = out[d];
+    }
+    sum_out *= K;
+    const float d_volume = set.d_t * (sum_in - sum_out);
+    const float d2 = std::max(0.f, d1 + (d_volume / (L * L)));
+    v.out_water[i] = d2;
+
+    // velocity from the flux of the previous step
+    const float depth = d1 + d2;
+    const float du =
+        from_left - v.flux[LEFT][i] + v.flux[RIGHT][i] - flux_at<EDGE>(v, LEFT, x + 1, y);
+    const float dv =
+        from_bottom - v.flux[BOTTOM][i] + v.flux[TOP][i] - flux_at<EDGE>(v, BOTTOM, x, y + 1);
+    // divide unconditionally and select, a conditional division keeps the loop scalar
+    const float vel_u = du / (L * depth);
+    const float vel_v = dv / (L * depth);
+    v.depth[i] = depth;
+    v.vel_u[i] = depth > 0 ? vel_u : 0.f;
+    v.vel_v[i] = depth > 0 ? vel_v : 0.f;
+}
+
+HYDR_SIMD_CLONES
+void flux_rows(View v, Erosion_data set, u32 begin, u32 end) {
+    for_rows(v, begin, end, [&]<bool EDGE>(i32 x, i32 y) HYDR_INLINE_LAMBDA {
+        flux_cell<EDGE>(v, set, x, y);
+    });
+}
+
+// ----------------------------- erosion -------------------------------
+// hydro_erosion.glsl, dissolves/deposits the top layer, then the rock under it
+
+template <bool EDGE>
+HYDR_INLINE float terrain_at(const View& v, i32 x, i32 y) {
+    if constexpr (EDGE) {
+        // imageLoad() outside of the image returns 0
+        if (v.outside(x, y)) {
+            return 0.f;
+        }
+    }
+    const size_t i = v.at(x, y);
+    return v.rock[i] + v.dirt[i];
+}
+
+// erosion constants as plain floats, glm's operator[] asserts on every access
+struct Erosion_rates {
+    float Kc;
+    float Kconv;
+    float d_t;
+    float Ks[SED_LAYERS];
+    float Kd[SED_LAYERS];
+};
+
+template <bool EDGE>
+HYDR_INLINE void erosion_cell(const View& v, const Erosion_rates& set, i32 x, i32 y) {
+    const size_t i = v.at(x, y);
+
+    // fade the velocity out for very shallow water, smoothstep is 0 above 1e-3
+    const float u = v.vel_u[i];
+    const float w = v.vel_v[i];
+    const float dd = std::max(5e-4f, v.depth[i]);
+    const float t = std::clamp((dd - 1e-3f) / (5e-4f - 1e-3f), 0.f, 1.f);
+    const float ero_vel = lerp(std::sqrt(u * u + w * w), 0.f, t * t * (3.f - 2.f * t));
+
+    // terrain normal, only its y component is needed
+    const float dx = terrain_at<EDGE>(v, x + 1, y) - terrain_at<EDGE>(v, x - 1, y);
+    const float dz = terrain_at<EDGE>(v, x, y + 1) - terrain_at<EDGE>(v, x, y - 1);
+    const float nx = 2.f * L * dx;
+    const float ny = -4.f * L * L;
+    const float nz = 2.f * L * dz;
+    const float norm_y = ny / std::sqrt(nx * nx + ny * ny + nz * nz);
+    const float sin_a = std::sqrt(1.f - norm_y * norm_y);
+    const float capacity = set.Kc * std::max(0.02f, sin_a) * ero_vel;
+
+    // the shader loop unrolled for the two layers, dirt first
+    const float c1 = std::max(0.f, capacity);
+    const float s1 = v.sediment[1][i];
+    const float amount1 = c1 > s1
+        ? set.d_t * set.Ks[1] * (c1 - s1)
+        : -(set.d_t * set.Kd[1] * (s1 - c1));
+    const float dirt_left = v.dirt[i] - amount1;
+    // dissolved completely: clamp to 0, give the deficit back to the sediment
+    // and pass the remaining capacity on to the rock, the loop breaks otherwise
+    const bool dissolve_dirt = c1 > s1;
+    const float dirt = dissolve_dirt ? std::max(0.f, dirt_left) : dirt_left;
+    const float dirt_deficit = dissolve_dirt ? std::min(0.f, dirt_left) : 0.f;
+    float sed_dirt = (s1 + amount1) + dirt_deficit;
+    const float cap = dirt_deficit < 0 ? v.dirt[i] : 0.f;
+    // negative when the loop reaches the rock, single float compares instead
+    // of combined bools, GCC does not vectorize mixed mask types
+    const float to_rock = dissolve_dirt ? dirt_deficit : -1.f;
+
+    const float c0 = std::max(0.f, capacity - cap);
+    const float s0 = v.sediment[0][i];
+    const float amount0 = c0 > s0
+        ? set.d_t * set.Ks[0] * (c0 - s0)
+        : -(set.d_t * set.Kd[0] * (s0 - c0));
+    const float rock_left = v.rock[i] - amount0;
+    const bool dissolve_rock = c0 > s0;
+    const float new_rock = dissolve_rock ? std::max(0.f, rock_left) : rock_left;
+    const float new_sed_rock = (s0 + amount0) + (dissolve_rock ? std::min(0.f, rock_left) : 0.f);
+    const float rock = to_rock < 0 ? new_rock : v.rock[i];
+    float sed_rock = to_rock < 0 ? new_sed_rock : s0;
+
+    // rock sediment slowly turns into dirt
+    const float conv = sed_rock * set.Kconv * set.d_t;
+    sed_dirt += conv;
+    sed_rock -= conv;
+
+    v.out_rock[i] = rock;
+    v.out_dirt[i] = dirt;
+    v.sediment[0][i] = sed_rock;
+    v.sediment[1][i] = sed_dirt;
+}
+
+HYDR_SIMD_CLONES
+void erosion_rows(View v, Erosion_data set, u32 begin, u32 end) {
+    const Erosion_rates rates {
+        .Kc     = set.Kc,
+        .Kconv  = set.Kconv,
+        .d_t    = set.d_t,
+        .Ks     = { set.Ks[0], set.Ks[1] },
+        .Kd     = { set.Kd[0], set.Kd[1] },
+    };
+    for_rows(v, begin, end, [&]<bool EDGE>(i32 x, i32 y) HYDR_INLINE_LAMBDA {
+        erosion_cell<EDGE>(v, rates, x, y);
+    });
+}
+
+// ---------------------------- sediment -------------------------------
+// sediment_transport.glsl, semi-lagrangian advection and evaporation
+
+HYDR_SIMD_CLONES
+void sediment_rows(View v, Erosion_data set, u32 begin, u32 end) {
+    const float max_pos = v.n - 1;
+    const float evaporation = 1.f - set.Ke * set.d_t;
+    for (i32 y = begin; y < i32(end); y++) {
+        HYDR_IVDEP
+        for (i32 x = 0; x < v.n; x++) {
+            const size_t i = v.at(x, y);
+            const float back_x = std::clamp(x - v.vel_u[i] * set.d_t, 0.f, max_pos);
+            const float back_y = std::clamp(y - v.vel_v[i] * set.d_t, 0.f, max_pos);
+            const i32 x0 = i32(back_x);
+            const i32 y0 = i32(back_y);
+            const float fx = back_x - x0;
+            const float fy = back_y - y0;
+            // the weight of the clamped texel is 0 on the last row/column
+            const i32 x1 = std::min(x0 + 1, v.n - 1);
+            const i32 y1 = std::min(y0 + 1, v.n - 1);
+            for (u32 l = 0; l < SED_LAYERS; l++) {
+                const float* sed = v.sediment[l];
+                const float s1 = lerp(sed[v.at(x0, y0)], sed[v.at(x1, y0)], fx);
+                const float s2 = lerp(sed[v.at(x0, y1)], sed[v.at(x1, y1)], fx);
+                v.out_sediment[l][i] = lerp(s1, s2, fy);
+            }
+            v.water[i] *= evaporation;
+        }
+    }
+}
+
+// ----------------------------- thermal -------------------------------
+// thermal_erosion.glsl + thermal_transport.glsl, the outflow of all layers is
+// computed from the same heights before any of it is moved
+
+// neighbour offsets in the order of the thermal fields
+constexpr i32 THERMAL_DX[8] = { -1, 1, 0, 0, -1, 1, -1, 1 };
+constexpr i32 THERMAL_DY[8] = { 0, 0, 1, -1, 1, 1, -1, -1 };
+// field of the neighbour that flows back into this cell
+constexpr u32 THERMAL_OPPOSITE[8] = { 1, 0, 3, 2, 7, 6, 5, 4 };
+
+// dirt_mask is 0 for the rock layer, rock + dirt height differences otherwise
+template <bool EDGE>
+HYDR_INLINE float layer_diff(const View& v, float dirt_mask, size_t i, i32 x, i32 y) {
+    if constexpr (EDGE) {
+        if (v.outside(x, y)) {
+            return (v.rock[i] - OUT_OF_MAP_HEIGHT) + dirt_mask * (v.dirt[i] - OUT_OF_MAP_HEIGHT);
+        }
+    }
+    const size_t n = v.at(x, y);
+    return (v.rock[i] - v.rock[n]) + dirt_mask * (v.dirt[i] - v.dirt[n]);
+}
+
+// cephes atanf for x >= 0, libm calls would keep the loop scalar
+HYDR_INLINE float atan_positive(float x) {
+    constexpr float PI = 3.14159265358979f;
+    const bool big = x > 2.414213562373095f;
+    const bool mid = x > 0.414213562373095f;
+    const float base = big ? PI / 2.f : mid ? PI / 4.f : 0.f;
+    const float r = big ? -1.f / x : mid ? (x - 1.f) / (x + 1.f) : x;
+    const float z = r * r;
+    return base + ((((8.05374449538e-2f * z - 1.38776856032e-1f) * z
+        + 1.99777106478e-1f) * z - 3.33329491539e-1f) * z * r + r);
+}
+
+// per layer constants of thermal_erosion.glsl
+struct Thermal_layer {
+    float dirt_mask;
+    float alpha;
+    float tan_alpha;
+    float speed;
+};
+
+template <bool EDGE>
+HYDR_INLINE void thermal_flux_cell(
+    const View& v, const float* terrain, float* const* out, const Thermal_layer& layer, float d_t, i32 x, i32 y
+) {
+    const size_t i = v.at(x, y);
+    float d_h[8];
+    float H = 0.f;
+    for (u32 k = 0; k < 8; k++) {
+        d_h[k] = layer_diff<EDGE>(v, layer.dirt_mask, i, x + THERMAL_DX[k], y + THERMAL_DY[k]);
+        H = std::max(H, d_h[k]);
+    }
+    H = std::min(terrain[i], H);
+
+    // atan(b / d) > Kalpha <=> b / d > tan(Kalpha), so the arc tangent is only
+    // needed once for the steepest slope
+    float bk = 0.f;
+    float steepest = 0.f;
+    bool marked[8];
+    for (u32 k = 0; k < 8; k++) {
+        const float d = (k < 4 ? L : L * std::numbers::sqrt2_v<float>) / WORLD_SCALE;
+        const float slope = d_h[k] / d;
+        marked[k] = d_h[k] > 0 && slope > layer.tan_alpha;
+        bk += marked[k] ? d_h[k] : 0.f;
+        steepest = marked[k] ? std::max(steepest, slope) : steepest;
+    }
+    float sharpness = std::max(1.f, 1.f + atan_positive(steepest) - layer.alpha);
+    sharpness *= sharpness * sharpness;
+    const float S = d_t * layer.speed * sharpness * L * H / 2.f;
+    for (u32 k = 0; k < 8; k++) {
+        out[k][i] = marked[k] ? S * d_h[k] / bk : 0.f;
+    }
+}
+
+HYDR_SIMD_CLONES
+void thermal_flux_rows(View v, Erosion_data set, u32 layer, u32 begin, u32 end) {
+    const Thermal_layer constants {
+        .dirt_mask  = layer > 0 ? 1.f : 0.f,
+        .alpha      = set.Kalpha[layer],
+        .tan_alpha  = std::tan(set.Kalpha[layer]),
+        .speed      = set.Kspeed[layer],
+    };
+    const float* terrain = layer == 0 ? v.rock : v.dirt;
+    float* const* out = v.thermal + 8 * layer;
+    for_rows(v, begin, end, [&]<bool EDGE>(i32 x, i32 y) HYDR_INLINE_LAMBDA {
+        thermal_flux_cell<EDGE>(v, terrain, out, constants, set.d_t, x, y);
+    });
+}
+
+template <bool EDGE>
+HYDR_INLINE void thermal_transport_cell(const View& v, u32 layer, i32 x, i32 y) {
+    const size_t i = v.at(x, y);
+    float* const* thermal = v.thermal + 8 * layer;
+    float in_flux = 0.f;
+    float sum = 0.f;
+    for (u32 k = 0; k < 8; k++) {
+        const i32 nx = x + THERMAL_DX[k];
+        const i32 ny = y + THERMAL_DY[k];
+        if constexpr (EDGE) {
+            if (!v.outside(nx, ny)) {
+                in_flux += thermal[THERMAL_OPPOSITE[k]][v.at(nx, ny)];
+            }
+        } else {
+            in_flux += thermal[THERMAL_OPPOSITE[k]][v.at(nx, ny)];
+        }
+        sum -= thermal[k][i];
+    }
+    sum += in_flux;
+    float* terrain = layer == 0 ? v.rock : v.dirt;
+    terrain[i] += sum;
+}
+
+HYDR_SIMD_CLONES
+void thermal_transport_rows(View v, u32 layer, u32 begin, u32 end) {
+    for_rows(v, begin, end, [&]<bool EDGE>(i32 x, i32 y) HYDR_INLINE_LAMBDA {
+        thermal_transport_cell<EDGE>(v, layer, x, y);
+    });
+}
+
+// ---------------------------- smoothing ------------------------------
+// smoothing.glsl without the particle momentum, border cells are kept
+
+// average of the neighbourhood at local minima/maxima, d = differences to l, r, t, b
+HYDR_INLINE float smooth_layer(const float* h, size_t i, const size_t nb[4], const float d[4]) {
+    const float hdiff = std::abs((d[0] + d[1] + d[2] + d[3]) / 4.f);
+    const bool x_extreme = (-d[0] > hdiff || -d[1] > hdiff) && d[0] * d[1] > 0;
+    const bool y_extreme = (-d[2] > hdiff || -d[3] > hdiff) && d[2] * d[3] > 0;
+    const float avg = (h[i] + h[nb[0]] + h[nb[1]] + h[nb[2]] + h[nb[3]]) / 5.f;
+    return (x_extreme || y_extreme) ? avg : h[i];
+}
+
+HYDR_SIMD_CLONES
+void smooth_rows(View v, Erosion_data set, u32 begin, u32 end) {
+    const float multip = std::clamp(set.Kspeed[1] * set.d_t, 0.f, 1.f);
+    for (i32 y = begin; y < i32(end); y++) {
+        if (y == 0 || y == v.n - 1) {
+            std::copy_n(v.rock + v.at(0, y), v.n, v.out_rock + v.at(0, y));
+            std::copy_n(v.dirt + v.at(0, y), v.n, v.out_dirt + v.at(0, y));
+            continue;
+        }
+        v.out_rock[v.at(0, y)] = v.rock[v.at(0, y)];
+        v.out_dirt[v.at(0, y)] = v.dirt[v.at(0, y)];
+        v.out_rock[v.at(v.n - 1, y)] = v.rock[v.at(v.n - 1, y)];
+        v.out_dirt[v.at(v.n - 1, y)] = v.dirt[v.at(v.n - 1, y)];
+
+        HYDR_IVDEP
+        for (i32 x = 1; x < v.n - 1; x++) {
+            const size_t i = v.at(x, y);
+            const size_t nb[4] = { v.at(x - 1, y), v.at(x + 1, y), v.at(x, y + 1), v.at(x, y - 1) };
+            // rock compares rock heights, dirt compares the total terrain height
+            float d_rock[4], d_dirt[4];
+            for (u32 k = 0; k < 4; k++) {
+                d_rock[k] = v.rock[i] - v.rock[nb[k]];
+                d_dirt[k] = v.dirt[i] - v.dirt[nb[k]] + d_rock[k];
+            }
+            const float rock = smooth_layer(v.rock, i, nb, d_rock);
+            const float dirt = smooth_layer(v.dirt, i, nb, d_dirt);
+            v.out_rock[i] = multip * rock + (1.f - multip) * v.rock[i];
+            v.out_dirt[i] = multip * dirt + (1.f - multip) * v.dirt[i];
+        }
+    }
+}
+
+}
+
+Cpu_grid Erosion::gen_cpu_grid(u32 size) {
+    const size_t cells = size_t(size) * size;
+    Cpu_grid grid { .size = size };
+    for (auto* field : {
+        &grid.rock, &grid.dirt, &grid.water,
+        &grid.out_rock, &grid.out_dirt, &grid.out_water,
+        &grid.vel_u, &grid.vel_v, &grid.depth
+    }) {
+        field->assign(cells, 0.f);
+    }
+    for (u32 i = 0; i < 4; i++) {
+        grid.flux[i].assign(cells, 0.f);
+        grid.out_flux[i].assign(cells, 0.f);
+    }
+    for (u32 i = 0; i < SED_LAYERS; i++) {
+        grid.sediment[i].assign(cells, 0.f);
+        grid.out_sediment[i].assign(cells, 0.f);
+    }
+    for (auto& field : grid.thermal) {
+        field.assign(cells, 0.f);
+    }
+    return grid;
+}
+
+size_t Erosion::cpu_grid_bytes(u32 size) {
+    // 6 height, 8 flux, 3 velocity, 4 sediment and 16 thermal fields
+    return size_t(size) * size * 37 * sizeof(float);
+}
+
+// splits an RGBA texture into up to 4 fields, nullptr skips a channel
+static void read_channels(const gl::Texture& tex, Arr<Vec<float>*, 4> fields) {
+    const size_t texels = size_t(tex.width) * tex.height;
+    Vec<float> pixels(texels * 4);
+    glGetTextureImage(
+        tex.texture, 0,
+        GL_RGBA, GL_FLOAT,
+        pixels.size() * sizeof(float), pixels.data()
+    );
+    for (u32 c = 0; c < 4; c++) {
+        if (fields[c] == nullptr) {
+            continue;
+        }
+        float* out = fields[c]->data();
+        for (size_t i = 0; i < texels; i++) {
+            out[i] = pixels[i * 4 + c];
+        }
+    }
+}
+
+static void write_channels(const gl::Texture& tex, Arr<const Vec<float>*, 4> fields) {
+    const size_t texels = size_t(tex.width) * tex.height;
+    Vec<float> pixels(texels * 4, 0.f);
+    for (u32 c = 0; c < 4; c++) {
+        if (fields[c] == nullptr) {
+            continue;
+        }
+        const float* in = fields[c]->data();
+        for (size_t i = 0; i < texels; i++) {
+            pixels[i * 4 + c] = in[i];
+        }
+    }
+    glTextureSubImage2D(
+        tex.texture, 0,
+        0, 0, tex.width, tex.height,
+        GL_RGBA, GL_FLOAT,
+        pixels.data()
+    );
+}
+
+void Erosion::download_grid(Cpu_grid& grid, const State::World::Textures& data) {
+    read_channels(data.heightmap.get_read_tex(), { &grid.rock, &grid.dirt, &grid.water, nullptr });
+    read_channels(data.flux.get_read_tex(), {
+        &grid.flux[LEFT], &grid.flux[RIGHT], &grid.flux[TOP], &grid.flux[BOTTOM]
+    });
+    read_channels(data.velocity, { &grid.vel_u, &grid.vel_v, &grid.depth, nullptr });
+    read_channels(data.sediment.get_read_tex(), {
+        &grid.sediment[0], &grid.sediment[1], nullptr, nullptr
+    });
+}
+
+void Erosion::upload_grid(const Cpu_grid& grid, State::World::Textures& data) {
+    Vec<float> total(grid.rock.size());
+    for (size_t i = 0; i < total.size(); i++) {
+        total[i] = grid.rock[i] + grid.dirt[i] + grid.water[i];
+    }
+    write_channels(data.heightmap.get_read_tex(), { &grid.rock, &grid.dirt, &grid.water, &total });
+    write_channels(data.flux.get_read_tex(), {
+        &grid.flux[LEFT], &grid.flux[RIGHT], &grid.flux[TOP], &grid.flux[BOTTOM]
+    });
+    write_channels(data.velocity, { &grid.vel_u, &grid.vel_v, &grid.depth, nullptr });
+    write_channels(data.sediment.get_read_tex(), {
+        &grid.sediment[0], &grid.sediment[1], nullptr, nullptr
+    });
+}
+
+void Erosion::dispatch_grid_rain(
+    Cpu_grid& grid,
+    const Rain_data& rain,
+    const Map_settings_data& map,
+    float time,
+    Thread_pool& pool
+) {
+    const View v = view(grid);
+    const float seed = (time * 1.372914227e3f - std::floor(time * 1.372914227e3f)) * 1000.f;
+    pool.parallel_for(grid.size, ROW_TILE, [&](u32 begin, u32 end) {
+        rain_rows(v, rain, map, seed, begin, end);
+    });
+}
+
+void Erosion::dispatch_thermal(Cpu_grid& grid, const Erosion_data& set, Thread_pool& pool) {
+    const View v = view(grid);
+    pool.parallel_for(grid.size, ROW_TILE, [&](u32 begin, u32 end) {
+        for (u32 layer = 0; layer < SED_LAYERS; layer++) {
+            thermal_flux_rows(v, set, layer, begin, end);
+        }
+    });
+    pool.parallel_for(grid.size, ROW_TILE, [&](u32 begin, u32 end) {
+        for (u32 layer = 0; layer < SED_LAYERS; layer++) {
+            thermal_transport_rows(v, layer, begin, end);
+        }
+    });
+}
+
+void Erosion::dispatch_smooth(Cpu_grid& grid, const Erosion_data& set, Thread_pool& pool) {
+    pool.parallel_for(grid.size, ROW_TILE, [&, v = view(grid)](u32 begin, u32 end) {
+        smooth_rows(v, set, begin, end);
+    });
+    std::swap(grid.rock, grid.out_rock);
+    std::swap(grid.dirt, grid.out_dirt);
+}
+
+void Erosion::dispatch_grid(Cpu_grid& grid, const Erosion_data& set, Thread_pool& pool) {
+    pool.parallel_for(grid.size, ROW_TILE, [&, v = view(grid)](u32 begin, u32 end) {
+        flux_rows(v, set, begin, end);
+    });
+    std::swap(grid.water, grid.out_water);
+    std::swap(grid.flux, grid.out_flux);
+
+    pool.parallel_for(grid.size, ROW_TILE, [&, v = view(grid)](u32 begin, u32 end) {
+        erosion_rows(v, set, begin, end);
+    });
+    std::swap(grid.rock, grid.out_rock);
+    std::swap(grid.dirt, grid.out_dirt);
+
+    pool.parallel_for(grid.size, ROW_TILE, [&, v = view(grid)](u32 begin, u32 end) {
+        sediment_rows(v, set, begin, end);
+    });
+    std::swap(grid.sediment, grid.out_sediment);
+
+    dispatch_thermal(grid, set, pool);
+    dispatch_smooth(grid, set, pool);
+}
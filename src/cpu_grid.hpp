@@ -0,0 +1,69 @@
+#ifndef HYDR_CPU_GRID_HPP
+#define HYDR_CPU_GRID_HPP
+
+#include "state.hpp"
+#include "thread_pool.hpp"
+
+// grid (virtual pipe) erosion on the CPU, a port of the grid compute passes
+namespace Erosion {
+
+// direction indices of the flux fields, same order as the fluxmap channels
+enum Flux_dir : u32 {
+    LEFT,
+    RIGHT,
+    TOP,
+    BOTTOM
+};
+
+// every channel of the GPU textures in its own array, rows of contiguous floats
+// fields that neighbours read during a pass are double buffered (out_*)
+struct Cpu_grid {
+    u32 size = 0;
+
+    // heightmap channels, total height is not stored
+    Vec<float> rock;
+    Vec<float> dirt;
+    Vec<float> water;
+    Vec<float> out_rock;
+    Vec<float> out_dirt;
+    Vec<float> out_water;
+
+    // outflow flux (left, right, top, bottom)
+    Arr<Vec<float>, 4> flux;
+    Arr<Vec<float>, 4> out_flux;
+
+    // velocitymap channels (u, v, mean water column)
+    Vec<float> vel_u;
+    Vec<float> vel_v;
+    Vec<float> depth;
+
+    // suspended sediment per layer (rock, dirt)
+    Arr<Vec<float>, SED_LAYERS> sediment;
+    Arr<Vec<float>, SED_LAYERS> out_sediment;
+
+    // thermal outflow per layer, cross (L, R, T, B) then diagonal (LT, RT, LB, RB)
+    Arr<Vec<float>, 8 * SED_LAYERS> thermal;
+};
+
+Cpu_grid gen_cpu_grid(u32 size);
+size_t cpu_grid_bytes(u32 size);
+
+// copies the world state between the GPU textures and the CPU grid
+void download_grid(Cpu_grid& grid, const State::World::Textures& data);
+void upload_grid(const Cpu_grid& grid, State::World::Textures& data);
+
+// CPU counterparts of the grid dispatches, results match the GPU within float error
+void dispatch_grid_rain(
+    Cpu_grid& grid,
+    const Rain_data& rain,
+    const Map_settings_data& map,
+    float time,
+    Thread_pool& pool
+);
+void dispatch_grid(Cpu_grid& grid, const Erosion_data& set, Thread_pool& pool);
+void dispatch_thermal(Cpu_grid& grid, const Erosion_data& set, Thread_pool& pool);
+// smoothing of the rock and dirt layers, shared with the CPU particle engine
+void dispatch_smooth(Cpu_grid& grid, const Erosion_data& set, Thread_pool& pool);
+
+};
+#endif // HYDR_CPU_GRID_HPP
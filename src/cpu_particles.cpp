@@ -0,0 +1,338 @@
+#include "cpu_particles.hpp"
+#include <cmath>
+using namespace Erosion;
+
+// particles per work item, fixed so the merge order doesn't depend on the thread count
+constexpr u32 PARTICLE_BATCH = 4096;
+// rows of a band, bands are merged in parallel
+constexpr u32 BAND_ROWS = 16;
+
+namespace {
+
+float glsl_fract(float x) {
+    return x - std::floor(x);
+}
+
+// hash from particle.glsl, spawn positions
+float rand(float px, float py) {
+    return glsl_fract(
+        1e4f * std::sin(17.f * px + py * 0.1f) * (0.1f + std::abs(std::sin(py * 13.f + px)))
+    );
+}
+
+// img_interpolation.glsl, texels outside the map are clamped to the border
+float bilinear(const Vec<float>& field, i32 n, glm::vec2 sample_pos) {
+    const glm::ivec2 pos = glm::ivec2(sample_pos * float(WORLD_SCALE));
+    const glm::vec2 s_pos = glm::fract(sample_pos * float(WORLD_SCALE));
+    auto fetch = [&](i32 x, i32 y) {
+        return field[size_t(std::clamp(y, 0, n - 1)) * n + std::clamp(x, 0, n - 1)];
+    };
+    const float v1 = glm::mix(fetch(pos.x, pos.y), fetch(pos.x + 1, pos.y), s_pos.x);
+    const float v2 = glm::mix(fetch(pos.x, pos.y + 1), fetch(pos.x + 1, pos.y + 1), s_pos.x);
+    return glm::mix(v1, v2, s_pos.y);
+}
+
+float terrain_at(const Cpu_grid& grid, glm::vec2 pos) {
+    return bilinear(grid.rock, grid.size, pos) + bilinear(grid.dirt, grid.size, pos);
+}
+
+glm::vec3 terr_normal(const Cpu_grid& grid, glm::vec2 pos) {
+    const float dx = terrain_at(grid, pos + glm::vec2(1.0, 0)) - terrain_at(grid, pos + glm::vec2(-1.0, 0));
+    const float dz = terrain_at(grid, pos + glm::vec2(0, 1.0)) - terrain_at(grid, pos + glm::vec2(0, -1.0));
+    return glm::normalize(glm::cross(glm::vec3(2.0, dx, 0), glm::vec3(0, dz, 2.0)));
+}
+
+// particle.glsl
+void move_particle(
+    ::Particle& p,
+    u32 id,
+    const Cpu_grid& grid,
+    const Cpu_particles& parts,
+    const Erosion_data& set,
+    float time,
+    bool should_rain
+) {
+    const float dims = float(grid.size);
+    // spawn particle if there's 0 iterations
+    if (p.iters == 0 && !should_rain) {
+        return;
+    }
+    for (u32 i = 0; i < SED_LAYERS; i++) {
+        if (p.sediment[i] < 0.f || p.iters == 0) {
+            p.sediment[i] = 0.f;
+        }
+    }
+    if (p.iters == 0 || p.to_kill) {
+        p.to_kill = false;
+        p.position = glm::vec2(
+            rand(glsl_fract(time * 1.37f) * 1000.f, float(id)) * (dims - 4.f) / WORLD_SCALE + 2.f,
+            rand(glsl_fract(time * 7.21f) * 1000.f, float(id) + 3.14f) * (dims - 4.f) / WORLD_SCALE + 2.f
+        );
+        p.velocity = glm::vec2(0);
+        p.volume = set.init_volume;
+        if (should_rain) {
+            p.iters = 1;
+        } else {
+            p.iters = 0;
+            return;
+        }
+    }
+    const glm::vec3 norm = terr_normal(grid, p.position);
+    const glm::vec2 momentum(
+        bilinear(parts.moment_x, grid.size, p.position),
+        bilinear(parts.moment_y, grid.size, p.position)
+    );
+    const float water = bilinear(grid.water, grid.size, p.position);
+
+    p.velocity -= (set.d_t * glm::vec2(norm.x, norm.z)) / p.volume * set.G;
+
+    if (glm::length(momentum) > 0 && glm::length(p.velocity) > 0) {
+        p.velocity += set.inertia
+            * glm::dot(glm::normalize(momentum), glm::normalize(p.velocity))
+            / (p.volume + 1e5f * water) * momentum;
+    }
+
+    // velocity is capped at length 1.0, otherwise particles can tunnel through terrain
+    if (glm::length(p.velocity) > 1.f) {
+        p.velocity = glm::normalize(p.velocity);
+    }
+
+    const glm::vec2 old_pos = p.position;
+    p.position += set.d_t * p.velocity;
+    if (p.position.x <= 1
+        || p.position.y <= 1
+        || p.position.x * WORLD_SCALE >= (dims - 2)
+        || p.position.y * WORLD_SCALE >= (dims - 2)
+    ) {
+        p.position = old_pos;
+        p.velocity = glm::vec2(0);
+        p.to_kill = true;
+    }
+    p.velocity *= (1.f - set.d_t * set.friction * norm.y);
+    p.volume -= set.d_t * set.Ke;
+
+    // sediment transport capacity calculations
+    const float sin_a = std::abs(std::sqrt(1.f - norm.y * norm.y));
+
+    p.sc = std::max(0.f, set.Kc * p.volume * glm::length(p.velocity) * std::max(0.02f, sin_a));
+    p.iters++;
+
+    if (p.volume <= set.min_volume
+        || glm::length(p.velocity) < set.min_velocity
+        || u32(p.iters) >= set.ttl
+    ) {
+        p.to_kill = true;
+    }
+}
+
+// erode_layers() of particle_erosion.glsl, records the change instead of storing it
+void erode_corner(
+    ::Particle& part,
+    const Cpu_grid& grid,
+    const Erosion_data& set,
+    u32 texel,
+    float multipl,
+    glm::vec2 old_sediment,
+    Vec<Texel_delta>& deltas
+) {
+    const float old_rock = grid.rock[texel];
+    const float old_dirt = grid.dirt[texel];
+    float terr[SED_LAYERS] = { old_rock, old_dirt };
+
+    // iterate over all layers
+    float cap = 0.0;
+    for (i32 i = (SED_LAYERS - 1); i >= 0; i--) {
+        // deposit sediment if the particle is supposed to die
+        if (part.to_kill) {
+            const float sed = old_sediment[i] * multipl;
+            terr[i] += sed;
+            part.sediment[i] -= sed;
+            continue;
+        }
+
+        const float Kls = set.d_t * set.Ks[i];
+        const float Kld = set.d_t * set.Kd[i];
+
+        // sediment transport capacity
+        const float c = std::max(0.f, part.sc - cap);
+
+        float s1 = old_sediment[i];
+        const float old_terr = terr[i];
+
+        // dissolve sediment
+        if (c > s1) {
+            const float eroded = multipl * Kls * (c - s1);
+            s1 += eroded;
+            terr[i] -= eroded;
+            if (terr[i] < 0) {
+                s1 += terr[i];
+                terr[i] = 0;
+                cap += old_terr;
+            } else {
+                part.sediment[i] = s1;
+                break;
+            }
+        }
+        // deposit sediment
+        else {
+            const float deposit = multipl * Kld * (s1 - c);
+            s1 -= deposit;
+            terr[i] += deposit;
+        }
+        part.sediment[i] = s1;
+    }
+    for (u32 i = 0; i < (SED_LAYERS - 1); i++) {
+        const float conv = part.sediment[i] * set.Kconv * set.d_t;
+        part.sediment[i + 1] += conv;
+        part.sediment[i] -= conv;
+    }
+    const glm::vec2 momentum = part.volume * part.velocity * multipl;
+    deltas.push_back({
+        .texel      = texel,
+        .rock       = terr[0] - old_rock,
+        .dirt       = terr[1] - old_dirt,
+        .water      = 1e-5f * part.volume * multipl,
+        .moment_x   = momentum.x,
+        .moment_y   = momentum.y,
+    });
+}
+
+void erode_particle(::Particle& part, const Cpu_grid& grid, const Erosion_data& set, Vec<Texel_delta>& deltas) {
+    if (part.iters == 0) {
+        return;
+    }
+    // get a quad
+    //  3---2
+    //  |   |
+    //  0---1
+    const glm::ivec2 base = glm::ivec2(part.position * float(WORLD_SCALE));
+    const glm::ivec2 pos[4] = { base, base + glm::ivec2(1, 0), base + glm::ivec2(1, 1), base + glm::ivec2(0, 1) };
+    // offset between points inside a quad
+    const glm::vec2 off = glm::fract(part.position * float(WORLD_SCALE));
+    const glm::vec2 offset[4] = {
+        glm::vec2(1.f - off.x, 1.f - off.y),
+        glm::vec2(off.x, 1.f - off.y),
+        glm::vec2(off.x, off.y),
+        glm::vec2(1.f - off.x, off.y),
+    };
+    const glm::vec2 sediment = part.sediment;
+    for (u32 i = 0; i < 4; i++) {
+        const u32 texel = u32(pos[i].y) * grid.size + u32(pos[i].x);
+        erode_corner(part, grid, set, texel, offset[i].x * offset[i].y, sediment, deltas);
+    }
+}
+
+// stable counting sort of the deltas into row bands
+void sort_by_band(Droplet_batch& batch, u32 size) {
+    const u32 bands = (size + BAND_ROWS - 1) / BAND_ROWS;
+    const u32 band_texels = BAND_ROWS * size;
+    batch.band_start.assign(bands + 1, 0);
+    for (const auto& delta : batch.deltas) {
+        batch.band_start[delta.texel / band_texels + 1]++;
+    }
+    for (u32 b = 0; b < bands; b++) {
+        batch.band_start[b + 1] += batch.band_start[b];
+    }
+    Vec<u32> next(batch.band_start.begin(), batch.band_start.end() - 1);
+    batch.sorted.resize(batch.deltas.size());
+    for (const auto& delta : batch.deltas) {
+        batch.sorted[next[delta.texel / band_texels]++] = delta;
+    }
+}
+
+// applies the deltas of every batch in batch order, bands don't share texels
+void merge_bands(Cpu_grid& grid, Cpu_particles& parts, u32 begin, u32 end) {
+    for (u32 band = begin; band < end; band++) {
+        for (const auto& batch : parts.batches) {
+            for (u32 d = batch.band_start[band]; d < batch.band_start[band + 1]; d++) {
+                const Texel_delta& delta = batch.sorted[d];
+                // droplets of the same step may remove more than there was, the
+                // GPU clamps per droplet under the lock
+                grid.rock[delta.texel] = std::max(0.f, grid.rock[delta.texel] + delta.rock);
+                grid.dirt[delta.texel] = std::max(0.f, grid.dirt[delta.texel] + delta.dirt);
+                grid.water[delta.texel] += delta.water;
+                parts.deposit_x[delta.texel] += delta.moment_x;
+                parts.deposit_y[delta.texel] += delta.moment_y;
+            }
+        }
+    }
+}
+
+// water display and momentum of smoothing.glsl, border cells are kept
+void decay_rows(Cpu_grid& grid, Cpu_particles& parts, const Erosion_data& set, u32 begin, u32 end) {
+    const i32 n = grid.size;
+    const float count = float(set.particle_count);
+    const float keep_moment = std::clamp(1.f - (1e-12f * count), 0.f, 1.f);
+    const float keep_water = std::clamp(1.f - (8e-8f * count), 0.f, 1.f);
+    for (i32 y = std::max<i32>(begin, 1); y < std::min<i32>(end, n - 1); y++) {
+        for (i32 x = 1; x < n - 1; x++) {
+            const size_t i = size_t(y) * n + x;
+            glm::vec2 momentum(parts.moment_x[i], parts.moment_y[i]);
+            momentum *= keep_moment;
+            momentum += (1e-12f * count) * glm::vec2(parts.deposit_x[i], parts.deposit_y[i]);
+            if (glm::length(momentum) < 1e-12f) {
+                momentum = glm::vec2(0);
+            }
+            parts.moment_x[i] = momentum.x;
+            parts.moment_y[i] = momentum.y;
+            parts.deposit_x[i] = 0.f;
+            parts.deposit_y[i] = 0.f;
+
+            grid.water[i] *= keep_water;
+            if (grid.water[i] < 1e-6f) {
+                grid.water[i] = 0.f;
+            }
+        }
+    }
+}
+
+}
+
+Cpu_particles Erosion::gen_cpu_particles(u32 size, u32 particle_count) {
+    const size_t cells = size_t(size) * size;
+    Cpu_particles parts;
+    // iters == 0, every particle spawns on its first step
+    parts.particles.assign(particle_count, ::Particle{});
+    for (auto* field : { &parts.moment_x, &parts.moment_y, &parts.deposit_x, &parts.deposit_y }) {
+        field->assign(cells, 0.f);
+    }
+    parts.batches.resize((particle_count + PARTICLE_BATCH - 1) / PARTICLE_BATCH);
+    for (auto& batch : parts.batches) {
+        batch.deltas.reserve(4 * PARTICLE_BATCH);
+    }
+    return parts;
+}
+
+void Erosion::dispatch_particle(
+    Cpu_grid& grid,
+    Cpu_particles& parts,
+    const Erosion_data& set,
+    float time,
+    bool should_rain,
+    Thread_pool& pool
+) {
+    const u32 count = parts.particles.size();
+    // the terrain stays untouched until the merge, every droplet sees the same map
+    pool.parallel_for(parts.batches.size(), 1, [&](u32 begin, u32 end) {
+        for (u32 b = begin; b < end; b++) {
+            auto& batch = parts.batches[b];
+            batch.deltas.clear();
+            for (u32 id = b * PARTICLE_BATCH; id < std::min(count, (b + 1) * PARTICLE_BATCH); id++) {
+                ::Particle& p = parts.particles[id];
+                move_particle(p, id, grid, parts, set, time, should_rain);
+                erode_particle(p, grid, set, batch.deltas);
+            }
+            sort_by_band(batch, grid.size);
+        }
+    });
+    const u32 bands = (grid.size + BAND_ROWS - 1) / BAND_ROWS;
+    pool.parallel_for(bands, 1, [&](u32 begin, u32 end) {
+        merge_bands(grid, parts, begin, end);
+    });
+
+    dispatch_thermal(grid, set, pool);
+    dispatch_smooth(grid, set, pool);
+    pool.parallel_for(grid.size, BAND_ROWS, [&](u32 begin, u32 end) {
+        decay_rows(grid, parts, set, begin, end);
+    });
+}
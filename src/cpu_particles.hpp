@@ -0,0 +1,58 @@
+#ifndef HYDR_CPU_PARTICLES_HPP
+#define HYDR_CPU_PARTICLES_HPP
+
+#include "cpu_grid.hpp"
+
+// droplet erosion on the CPU, a port of particle.glsl and particle_erosion.glsl
+// without the lockmap: droplets erode the terrain as it was at the start of the
+// step and their changes are merged in particle order, so the result is the
+// same for any number of threads
+namespace Erosion {
+
+// change of one texel caused by one corner of a droplet
+struct Texel_delta {
+    u32 texel;
+    float rock;
+    float dirt;
+    float water;
+    // momentum deposited into the momentmap (z, w)
+    float moment_x;
+    float moment_y;
+};
+
+// deltas of a fixed range of particles, sorted by row band for the merge
+struct Droplet_batch {
+    Vec<Texel_delta> deltas;
+    Vec<Texel_delta> sorted;
+    // sorted[band_start[b], band_start[b + 1]) lies in band b
+    Vec<u32> band_start;
+};
+
+struct Cpu_particles {
+    // bindings.glsl layout, Erosion::Particle are the particle shaders
+    Vec<::Particle> particles;
+
+    // momentmap channels, smoothed momentum (x, y), momentum deposited during a step (z, w)
+    Vec<float> moment_x;
+    Vec<float> moment_y;
+    Vec<float> deposit_x;
+    Vec<float> deposit_y;
+
+    Vec<Droplet_batch> batches;
+};
+
+Cpu_particles gen_cpu_particles(u32 size, u32 particle_count);
+
+// moves, erodes and deposits with every particle, then runs thermal erosion and
+// smoothing on the grid, the CPU counterpart of the particle dispatch
+void dispatch_particle(
+    Cpu_grid& grid,
+    Cpu_particles& parts,
+    const Erosion_data& set,
+    float time,
+    bool should_rain,
+    Thread_pool& pool
+);
+
+};
+#endif // HYDR_CPU_PARTICLES_HPP
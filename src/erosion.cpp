@@ -1,13 +1,23 @@
 #include "erosion.hpp"
+#include "profiler.hpp"
 using namespace Erosion;
 
 // shader filenames
 
 // grid based
 constexpr auto grid_rain_comput_file    = "rain.glsl";
+constexpr auto rain_pattern_file        = "rain_pattern.glsl";
 constexpr auto grid_hydro_flux_file     = "hydro_flux.glsl";
 constexpr auto grid_hydro_erosion_file  = "hydro_erosion.glsl";
 constexpr auto grid_sediment_file       = "sediment_transport.glsl";
+constexpr auto grid_step_file           = "grid_step.glsl";
+constexpr auto cfl_reduce_file          = "cfl_reduce.glsl";
+constexpr auto cfl_step_file            = "cfl_step.glsl";
+constexpr auto tile_list_file           = "tile_list.glsl";
+constexpr auto water_restrict_file      = "water_restrict.glsl";
+constexpr auto water_outflow_file       = "water_outflow.glsl";
+constexpr auto water_update_file        = "water_update.glsl";
+constexpr auto water_prolong_file       = "water_prolong.glsl";
 
 // thermal erosion - grid based
 constexpr auto thermal_flux_file        = "thermal_erosion.glsl";
@@ -17,6 +27,257 @@ constexpr auto smooth_file              = "smoothing.glsl";
 // particle based
 constexpr auto particle_move_file       = "particle.glsl";
 constexpr auto particle_erosion_file    = "particle_erosion.glsl";
+constexpr auto deposit_resolve_file     = "deposit_resolve.glsl";
+constexpr auto particle_steps_file      = "particle_steps.glsl";
+constexpr auto particle_bin_file        = "particle_bin.glsl";
+constexpr auto particle_scan_file       = "particle_scan.glsl";
+constexpr auto particle_scatter_file    = "particle_scatter.glsl";
+constexpr auto particle_compact_file    = "particle_compact.glsl";
+
+// the split kernel always covers the whole map
+constexpr bool DENSE = false;
+
+// multigrid water passes between the heightmap and the first level or two levels
+constexpr bool TOP_LEVEL = true;
+constexpr bool COARSE_LEVEL = false;
+// relaxation sweeps on every level of the water pyramid per cycle
+constexpr u32 MULTIGRID_SWEEPS = 8;
+
+// resolves the bindings of every dispatch of an erosion step once
+void build_passes(Programs& prog, State::World::Textures& data) {
+    using enum Compute_pass::Slot;
+    const u32& size = data.map_size;
+
+    Compute_pass thermal_flux(prog.thermal.flux, Profiler::THERMAL_FLUX, size);
+    Compute_pass thermal_transport(prog.thermal.transport, Profiler::THERMAL_TRANSPORT, size);
+    thermal_flux.texture("heightmap", data.heightmap);
+    thermal_transport
+        .texture("heightmap", data.heightmap)
+        .image("out_heightmap", data.heightmap, WRITE)
+        .swap(data.heightmap);
+    for (int i = 0; i < SED_LAYERS; i++) {
+        thermal_flux
+            .image(fmt::format("out_thflux_c[{}]", i).c_str(), data.thermal_c[i])
+            .image(fmt::format("out_thflux_d[{}]", i).c_str(), data.thermal_d[i]);
+        thermal_transport
+            .texture(fmt::format("thflux_c[{}]", i).c_str(), data.thermal_c[i])
+            .texture(fmt::format("thflux_d[{}]", i).c_str(), data.thermal_d[i]);
+    }
+    prog.thermal.passes = {thermal_flux, thermal_transport};
+
+    Compute_pass smooth(prog.thermal.smooth, Profiler::SMOOTH, size);
+    smooth
+        .image("heightmap", data.heightmap, READ)
+        .image("out_heightmap", data.heightmap, WRITE);
+
+    if (prog.particle != nullptr) {
+        auto& particle = *prog.particle;
+        const u32& count = data.particle_count;
+        // over the whole buffer or the live droplets
+        auto droplet_pass = [&](Compute_program& program, u32 profiler_pass) {
+            return Compute_pass(program, profiler_pass, count, Compute_pass::PARTICLES)
+                .uniform("compact", particle.use_live_list)
+                .indirect_from(data.particle_live, particle.use_live_list);
+        };
+        particle.passes = {
+            droplet_pass(particle.movement, Profiler::PARTICLE_MOVEMENT)
+                .uniform("time", data.time)
+                .uniform("should_rain", particle.should_rain)
+                .texture("heightmap", data.heightmap)
+                .texture("momentmap", data.velocity)
+        };
+        if (data.deposition == State::World::ATOMIC) {
+            auto erosion = droplet_pass(particle.erosion, Profiler::PARTICLE_EROSION);
+            Compute_pass resolve(particle.resolve, Profiler::DEPOSIT_RESOLVE, size);
+            for (int i = 0; i < DEPOSIT_LAYERS; i++) {
+                const auto var = fmt::format("deposits[{}]", i);
+                erosion.image(var.c_str(), data.deposits[i]);
+                resolve.image(var.c_str(), data.deposits[i]);
+            }
+            erosion.image("heightmap", data.heightmap, READ);
+            resolve
+                .image("heightmap", data.heightmap, READ)
+                .image("momentmap", data.velocity);
+            particle.passes.push_back(erosion);
+            particle.passes.push_back(resolve);
+            // see particle_step
+            particle.substep_passes.clear();
+        } else {
+            particle.passes.push_back(
+                droplet_pass(particle.erosion, Profiler::PARTICLE_EROSION)
+                    .image("lockmap", data.lockmap)
+                    .image("heightmap", data.heightmap, READ)
+                    .image("momentmap", data.velocity)
+            );
+            particle.substep_passes = {
+                droplet_pass(particle.steps, Profiler::PARTICLE_STEPS)
+                    .uniform("time", data.time)
+                    .uniform("should_rain", particle.should_rain)
+                    .uniform("substeps", particle.substeps)
+                    .image("lockmap", data.lockmap)
+                    .image("heightmap", data.heightmap, READ)
+                    .image("momentmap", data.velocity)
+            };
+        }
+        particle.sort_passes = {
+            Compute_pass(particle.bin, Profiler::PARTICLE_BIN, count, Compute_pass::PARTICLES),
+            Compute_pass(particle.scan, Profiler::PARTICLE_SCAN, count, Compute_pass::SINGLE)
+                .barrier(GL_SHADER_STORAGE_BARRIER_BIT),
+            Compute_pass(particle.scatter, Profiler::PARTICLE_SCATTER, count, Compute_pass::PARTICLES)
+        };
+        particle.compact_passes = {
+            Compute_pass(particle.compact, Profiler::PARTICLE_COMPACT, count, Compute_pass::PARTICLES)
+        };
+        smooth
+            .image("momentmap", data.velocity)
+            .swap(data.heightmap, true);
+    } else {
+        // momentmap only exists in the PARTICLE_EROSION variant
+        smooth.swap(data.heightmap);
+    }
+    prog.thermal.smooth_passes = {smooth};
+
+    if (prog.grid != nullptr) {
+        auto& grid = *prog.grid;
+        Compute_pass rain(grid.rain, Profiler::RAIN, size);
+        Compute_pass rain_pattern(grid.rain_pattern, Profiler::RAIN_PATTERN, size);
+        rain
+            .uniform("time", data.time)
+            .uniform("cached", grid.cached_rain)
+            .image("heightmap", data.heightmap, READ);
+        rain_pattern.uniform("drops", data.rain_pattern_drops);
+        for (int i = 0; i < RAIN_PATTERNS; i++) {
+            const auto var = fmt::format("patterns[{}]", i);
+            rain.texture(var.c_str(), data.rain_patterns[i]);
+            rain_pattern.image(var.c_str(), data.rain_patterns[i]);
+        }
+        grid.rain_passes = {rain};
+        grid.rain_pattern_passes = {rain_pattern};
+        // both read the step buffer the other one wrote
+        grid.adaptive_passes = {
+            Compute_pass(grid.cfl_reduce, Profiler::CFL_REDUCE, size)
+                .texture("heightmap", data.heightmap)
+                .texture("velocitymap", data.velocity)
+                .barrier(GL_SHADER_STORAGE_BARRIER_BIT),
+            Compute_pass(grid.cfl_step, Profiler::CFL_STEP, size, Compute_pass::SINGLE)
+                .uniform("period", grid.adaptive_steps)
+                .uniform("refund", grid.adaptive_refund)
+                .barrier(GL_SHADER_STORAGE_BARRIER_BIT)
+        };
+        grid.tile_passes = {
+            Compute_pass(grid.tile_list, Profiler::TILE_LIST, size, Compute_pass::TILES)
+                .barrier(GL_SHADER_STORAGE_BARRIER_BIT)
+        };
+        auto sediment = Compute_pass(grid.sediment, Profiler::SEDIMENT, size)
+            .texture("heightmap", data.heightmap)
+            .texture("velocitymap", data.velocity)
+            .texture("sedimap", data.sediment)
+            .image("out_heightmap", data.heightmap, WRITE)
+            .image("out_sedimap", data.sediment, WRITE)
+            .swap(data.heightmap)
+            .swap(data.sediment);
+        grid.fused_passes = {
+            // reads and writes the tile states in dense runs too
+            Compute_pass(grid.step, Profiler::GRID_STEP, size)
+                .uniform("sparse", grid.sparse)
+                .indirect_from(data.tile_list, grid.sparse)
+                .barrier(GL_SHADER_STORAGE_BARRIER_BIT)
+                .texture("heightmap", data.heightmap)
+                .texture("fluxmap", data.flux)
+                .texture("sedimap", data.sediment)
+                .image("velocitymap", data.velocity)
+                .image("out_heightmap", data.heightmap, WRITE)
+                .image("out_fluxmap", data.flux, WRITE)
+                .image("out_sedimap", data.sediment, WRITE)
+                .swap(data.heightmap)
+                .swap(data.flux)
+                .swap(data.sediment),
+            Compute_pass(sediment)
+                .uniform("sparse", grid.sparse)
+                .indirect_from(data.tile_list, grid.sparse)
+        };
+        // restriction down the water pyramid, then from the coarsest level up:
+        // relaxation sweeps and the change prolonged to the level above, the
+        // levels of size 0 dispatch nothing
+        grid.multigrid_passes.clear();
+        for (u32 i = 0; i < State::World::WATER_LEVELS; i++) {
+            Compute_pass restriction(
+                grid.water_restrict, Profiler::WATER_RESTRICT, data.water_level_sizes[i]
+            );
+            restriction.image("coarse_level", data.water_levels[i]);
+            if (i == 0) {
+                restriction
+                    .uniform("top", TOP_LEVEL)
+                    .image("heightmap", data.heightmap, READ)
+                    .unbind_image("fine_level");
+            } else {
+                restriction
+                    .uniform("top", COARSE_LEVEL)
+                    .unbind_image("heightmap")
+                    .image("fine_level", data.water_levels[i - 1]);
+            }
+            grid.multigrid_passes.push_back(restriction);
+        }
+        for (u32 i = State::World::WATER_LEVELS; i-- > 0;) {
+            const u32& level_size = data.water_level_sizes[i];
+            for (u32 sweep = 0; sweep < MULTIGRID_SWEEPS; sweep++) {
+                grid.multigrid_passes.push_back(
+                    Compute_pass(grid.water_outflow, Profiler::WATER_OUTFLOW, level_size)
+                        .image("level", data.water_levels[i])
+                        .image("outflow", data.water_outflow)
+                );
+                grid.multigrid_passes.push_back(
+                    Compute_pass(grid.water_update, Profiler::WATER_UPDATE, level_size)
+                        .image("level", data.water_levels[i])
+                        .image("outflow", data.water_outflow)
+                );
+            }
+            Compute_pass prolongation(grid.water_prolong, Profiler::WATER_PROLONG, level_size);
+            prolongation.image("coarse_level", data.water_levels[i]);
+            if (i == 0) {
+                prolongation
+                    .uniform("top", TOP_LEVEL)
+                    .image("heightmap", data.heightmap, READ)
+                    .unbind_image("fine_level");
+            } else {
+                prolongation
+                    .uniform("top", COARSE_LEVEL)
+                    .unbind_image("heightmap")
+                    .image("fine_level", data.water_levels[i - 1]);
+            }
+            grid.multigrid_passes.push_back(prolongation);
+        }
+
+        sediment.uniform("sparse", DENSE);
+        grid.split_passes = {
+            Compute_pass(grid.flux, Profiler::FLUX, size)
+                .texture("heightmap", data.heightmap)
+                .texture("fluxmap", data.flux)
+                .image("velocitymap", data.velocity)
+                .image("out_heightmap", data.heightmap, WRITE)
+                .image("out_fluxmap", data.flux, WRITE)
+                .swap(data.heightmap)
+                .swap(data.flux),
+            Compute_pass(grid.erosion, Profiler::EROSION, size)
+                .image("heightmap", data.heightmap, READ)
+                .image("sedimap", data.sediment, READ)
+                .image("velocitymap", data.velocity)
+                .image("out_heightmap", data.heightmap, WRITE)
+                .image("out_sedimap", data.sediment, WRITE)
+                .swap(data.heightmap)
+                .swap(data.sediment),
+            sediment
+        };
+    }
+}
+
+// every stream of particle_streams.glsl
+void bind_particle_streams(Compute_program& program, State::World::Particle_streams& streams) {
+    program.bind_storage_buffer("ParticleMotion", streams.motion);
+    program.bind_storage_buffer("ParticleState", streams.state);
+    program.bind_storage_buffer("ParticleSediment", streams.sediment);
+    program.bind_storage_buffer("ParticleKill", streams.kill);
+}
 
 Programs* Erosion::setup_shaders(
         Programs::Erosion_type type, 
@@ -24,177 +285,224 @@ Programs* Erosion::setup_shaders(
         State::World::Textures& data, 
         u32 particle_count
 ) {
-    // compile compute shaders
+    // compile compute shaders, image formats follow the texture storage, the
+    // map size and the erosion type are constants of every kernel
+    const auto defines = State::World::kernel_defines(data);
+    const auto erosion_defines = data.deposition == State::World::ATOMIC ?
+        defines + "#define ATOMIC_DEPOSITION\n" : defines;
     auto prog = new Programs{
         type,
-        type == Programs::PARTICLES ? new Particle{
-            .movement   = Compute_program(particle_move_file),
-            .erosion    = Compute_program(particle_erosion_file)
-        } : nullptr,
-        type == Programs::GRID ? new Grid{
-            .flux       = Compute_program(grid_hydro_flux_file),
-            .erosion    = Compute_program(grid_hydro_erosion_file),
-            .sediment   = Compute_program(grid_sediment_file),
-            .rain       = Compute_program(grid_rain_comput_file)
-        } : nullptr,
+        Uq_ptr<Particle>(type == Programs::PARTICLES ? new Particle{
+            .movement   = Compute_program(particle_move_file, defines),
+            .erosion    = Compute_program(particle_erosion_file, erosion_defines),
+            .resolve    = Compute_program(deposit_resolve_file, defines),
+            .steps      = Compute_program(particle_steps_file, defines),
+            .bin        = Compute_program(particle_bin_file, defines),
+            .scan       = Compute_program(particle_scan_file, defines),
+            .scatter    = Compute_program(particle_scatter_file, defines),
+            .compact    = Compute_program(particle_compact_file, defines)
+        } : nullptr),
+        Uq_ptr<Grid>(type == Programs::GRID ? new Grid{
+            .flux       = Compute_program(grid_hydro_flux_file, defines),
+            .erosion    = Compute_program(grid_hydro_erosion_file, defines),
+            .sediment   = Compute_program(grid_sediment_file, defines),
+            .rain       = Compute_program(grid_rain_comput_file, defines),
+            .rain_pattern = Compute_program(rain_pattern_file, defines),
+            .rain_data  = &set.rain.data,
+            .step       = Compute_program(grid_step_file, defines),
+            .cfl_reduce = Compute_program(cfl_reduce_file, defines),
+            .cfl_step   = Compute_program(cfl_step_file, defines),
+            .erosion_version = &set.erosion.version,
+            .tile_list  = Compute_program(tile_list_file, defines),
+            .water_restrict = Compute_program(water_restrict_file, defines),
+            .water_outflow  = Compute_program(water_outflow_file, defines),
+            .water_update   = Compute_program(water_update_file, defines),
+            .water_prolong  = Compute_program(water_prolong_file, defines)
+        } : nullptr),
         Thermal{
-            .flux       = {
-                Compute_program(thermal_flux_file),
-                Compute_program(thermal_flux_file)
-            },
-            .transport  = {
-                Compute_program(thermal_transport_file),
-                Compute_program(thermal_transport_file)
-            },
-            .smooth     = Compute_program(smooth_file)
+            .flux       = Compute_program(thermal_flux_file, defines),
+            .transport  = Compute_program(thermal_transport_file, defines),
+            .smooth     = Compute_program(smooth_file, defines)
         },
     };
-
-    for (int i = 0; i < SED_LAYERS; i++) {
-        prog->thermal.flux[i].use();
-        prog->thermal.flux[i].bind_uniform_block("erosion_data", set.erosion.buffer);
-        prog->thermal.flux[i].set_uniform("t_layer", i);
-        prog->thermal.transport[i].use();
-        prog->thermal.transport[i].set_uniform("t_layer", i);
-        glUseProgram(0);
-    }
+    prog->thermal.flux.bind_uniform_block("erosion_data", set.erosion.buffer);
 
     if (prog->grid != nullptr) {
         prog->grid->flux.bind_uniform_block("erosion_data", set.erosion.buffer);
         prog->grid->erosion.bind_uniform_block("erosion_data", set.erosion.buffer);
         prog->grid->sediment.bind_uniform_block("erosion_data", set.erosion.buffer);
+        prog->grid->step.bind_uniform_block("erosion_data", set.erosion.buffer);
+        prog->grid->cfl_reduce.bind_uniform_block("erosion_data", set.erosion.buffer);
+        // cfl_step.glsl writes d_t into the uniform buffer
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BIND_EROSION_STORAGE, set.erosion.buffer.bo);
     } 
     if (prog->particle != nullptr) {
         prog->particle->movement.bind_uniform_block("map_settings", set.map.buffer);
         prog->particle->erosion.bind_uniform_block("erosion_data", set.erosion.buffer);
-        prog->particle->movement.bind_storage_buffer("ParticleBuffer", data.particle_buffer);
-        prog->particle->erosion.bind_storage_buffer("ParticleBuffer", data.particle_buffer);
+        prog->particle->steps.bind_uniform_block("map_settings", set.map.buffer);
+        prog->particle->steps.bind_uniform_block("erosion_data", set.erosion.buffer);
+        bind_particle_streams(prog->particle->steps, data.particles);
+        bind_particle_streams(prog->particle->movement, data.particles);
+        bind_particle_streams(prog->particle->erosion, data.particles);
+        bind_particle_streams(prog->particle->scatter, data.particles);
+        prog->particle->bin.bind_storage_buffer("ParticleMotion", data.particles.motion);
+        prog->particle->bin.bind_storage_buffer("ParticleState", data.particles.state);
+        prog->particle->compact.bind_storage_buffer("ParticleState", data.particles.state);
     }
+    prog->map_size = data.map_size;
+    build_passes(*prog, data);
     return prog;
 }
 
-void Erosion::dispatch_grid_rain(Programs& prog, State::World::Textures& data) {
-    prog.grid->rain.use();
-    prog.grid->rain.set_uniform("time", data.time);
-    prog.grid->rain.bind_image("heightmap", data.heightmap.get_read_tex());
-    prog.grid->rain.bind_image("out_heightmap", data.heightmap.get_write_tex());
-    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
-    glDispatchCompute(
-        data.map_size / WRKGRP_SIZE_X,
-        data.map_size / WRKGRP_SIZE_Y, 
-        1
-    );
-    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
-    data.heightmap.swap();
+// whatever reads the textures after erosion: the renderer samples and binds
+// them as images, batch runs read them back
+constexpr GLbitfield READER_BARRIERS =
+    GL_TEXTURE_FETCH_BARRIER_BIT |
+    GL_SHADER_IMAGE_ACCESS_BARRIER_BIT |
+    GL_TEXTURE_UPDATE_BARRIER_BIT;
+
+void grid_step(Programs& prog, State::World::Textures& data) {
+    if (prog.grid->fused && prog.grid->sparse) {
+        // tile_list.glsl counts the dispatch size up from 0, after the atomics
+        // of the last step are done with it
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+        const GLuint zero = 0;
+        glClearNamedBufferSubData(
+            data.tile_list.bo, GL_R32UI, 0, sizeof(GLuint),
+            GL_RED_INTEGER, GL_UNSIGNED_INT, &zero
+        );
+        dispatch(prog.grid->tile_passes);
+    }
+    dispatch(prog.grid->fused ? prog.grid->fused_passes : prog.grid->split_passes);
+    dispatch(prog.thermal.passes);
+    dispatch(prog.thermal.smooth_passes);
 }
 
-// helper functions
-void run(Compute_program& program, u32 size) {
-    program.use();
-    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
-    glDispatchCompute(
-        size / WRKGRP_SIZE_X,
-        size / WRKGRP_SIZE_Y,
-        1
+void grid_rain(Programs& prog, State::World::Textures& data) {
+    auto& grid = *prog.grid;
+    // new textures or another drops setting
+    if (grid.cached_rain && data.rain_pattern_drops != grid.rain_data->drops) {
+        data.rain_pattern_drops = grid.rain_data->drops;
+        dispatch(grid.rain_pattern_passes);
+    }
+    dispatch(grid.rain_passes);
+}
+
+void particle_sort(Programs& prog, State::World::Textures& data) {
+    // the scatter pass reads the droplets from a copy and writes them back in
+    // order of their bins, which particle_bin.glsl counts up from 0, the kill
+    // bits are or-ed into the cleared mask
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    const size_t count = data.particle_count;
+    auto& from = data.particles;
+    auto& to = data.particle_scratch;
+    glCopyNamedBufferSubData(from.motion.bo, to.motion.bo, 0, 0, count * sizeof(Particle_motion));
+    glCopyNamedBufferSubData(from.state.bo, to.state.bo, 0, 0, count * sizeof(Particle_state));
+    glCopyNamedBufferSubData(
+        from.sediment.bo, to.sediment.bo, 0, 0, count * SED_LAYERS * sizeof(GLfloat)
+    );
+    glCopyNamedBufferSubData(
+        from.kill.bo, to.kill.bo, 0, 0, (count + 31) / 32 * sizeof(GLuint)
     );
-    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
-};
+    glClearNamedBufferData(from.kill.bo, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    glClearNamedBufferData(data.particle_bins.bo, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    dispatch(prog.particle->sort_passes);
+}
 
-void run_thermal_erosion(Programs& prog, State::World::Textures& data) {
-    for (int i = 0; i < SED_LAYERS; i++) {
-        prog.thermal.flux[i].use();
-        prog.thermal.flux[i].bind_texture("heightmap", data.heightmap.get_read_tex());
-        prog.thermal.flux[i].bind_image("out_thflux_c", data.thermal_c.get_write_tex());
-        prog.thermal.flux[i].bind_image("out_thflux_d", data.thermal_d.get_write_tex());
-        run(prog.thermal.flux[i], data.map_size);
-        data.thermal_c.swap();
-        data.thermal_d.swap();
-
-        prog.thermal.transport[i].use();
-        prog.thermal.transport[i].bind_texture("heightmap", data.heightmap.get_read_tex());
-        prog.thermal.transport[i].bind_image("out_heightmap", data.heightmap.get_write_tex());
-        prog.thermal.transport[i].bind_texture("thflux_c", data.thermal_c.get_read_tex());
-        prog.thermal.transport[i].bind_texture("thflux_d", data.thermal_d.get_read_tex());
-        run(prog.thermal.transport[i], data.map_size);
-        data.heightmap.swap();
+void particle_step(Programs& prog, State::World::Textures& data, bool should_rain) {
+    auto& particle = *prog.particle;
+    particle.should_rain = should_rain;
+    // every droplet moves while it rains, the idle ones respawn
+    particle.use_live_list = particle.compact_live && !should_rain;
+    if (particle.use_live_list) {
+        // particle_compact.glsl counts the list and the dispatch size up from 0,
+        // after the atomics of the last step are done with it
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+        const GLuint dispatch_args[4] = {0, 1, 1, 0};
+        glNamedBufferSubData(data.particle_live.bo, 0, sizeof(dispatch_args), dispatch_args);
+        dispatch(particle.compact_passes);
+    }
+    if (particle.substeps > 1 && data.deposition == State::World::LOCKED) {
+        dispatch(particle.substep_passes);
+    } else {
+        // atomic deposits are resolved after every droplet step so the next
+        // one moves over the eroded terrain, the map passes in between stay
+        // left out, a droplet spawns with the time of its step like in
+        // particle_steps.glsl
+        const float time = data.time;
+        for (u32 i = 0; i < particle.substeps; i++) {
+            data.time = time + float(i);
+            dispatch(particle.passes);
+        }
+        data.time = time;
     }
+    dispatch(prog.thermal.passes);
+    dispatch(prog.thermal.smooth_passes);
 }
 
-void run_particles(Compute_program& program, u32 particle_count) {
-    program.use();
-    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
-    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
-    glDispatchCompute(particle_count / (WRKGRP_SIZE_X * WRKGRP_SIZE_Y), 1, 1);
-    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+void Erosion::step(Programs& prog, State::World::Textures& data, const Steps& steps) {
+    const float start = data.time;
+    const u32 adaptive_period = prog.grid != nullptr ? prog.grid->adaptive_period : 0;
+    const u32 sort_period = prog.particle != nullptr ? prog.particle->sort_period : 0;
+    const u32 multigrid_period = prog.grid != nullptr ? prog.grid->multigrid_period : 0;
+    for (u32 i = 0; i < steps.count; i++) {
+        data.time = start + i * steps.time_step;
+        if (prog.type == Programs::PARTICLES) {
+            if (sort_period && !((steps.first + i - 1) % sort_period)) {
+                particle_sort(prog, data);
+            }
+            particle_step(prog, data, steps.should_rain);
+            continue;
+        }
+        if (steps.should_rain && !((steps.first + i) % steps.rain_period)) {
+            grid_rain(prog, data);
+        }
+        // after the rain so the new water counts, early when the CPU pushed
+        // the settings over the last d_t
+        const u32 into = adaptive_period ? (steps.first + i - 1) % adaptive_period : 0;
+        auto& grid = *prog.grid;
+        if (adaptive_period && (!into || grid.adaptive_version != *grid.erosion_version)) {
+            grid.adaptive_steps = adaptive_period - into;
+            grid.adaptive_refund = into ? grid.adaptive_steps : 0;
+            grid.adaptive_version = *grid.erosion_version;
+            dispatch(grid.adaptive_passes);
+            glMemoryBarrier(GL_UNIFORM_BARRIER_BIT);
+        }
+        grid_step(prog, data);
+        if (multigrid_period && !((steps.first + i) % multigrid_period)) {
+            dispatch(prog.grid->multigrid_passes);
+        }
+    }
+    // Textures::step is read through the persistent mapping
+    glMemoryBarrier(READER_BARRIERS | (adaptive_period ? GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT : 0));
+}
+
+void Erosion::dispatch_grid_rain(Programs& prog, State::World::Textures& data) {
+    grid_rain(prog, data);
+    glMemoryBarrier(READER_BARRIERS);
+}
+
+void Erosion::sort_particles(Programs& prog, State::World::Textures& data) {
+    particle_sort(prog, data);
     glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
-};
+}
+
+void Erosion::dispatch_thermal(Programs& prog, State::World::Textures& data) {
+    dispatch(prog.thermal.passes);
+    glMemoryBarrier(READER_BARRIERS);
+}
 
 void Erosion::dispatch_particle(Programs& prog, State::World::Textures& data, bool should_rain) {
-    prog.particle->movement.use();
-    prog.particle->movement.set_uniform("time", data.time);
-    prog.particle->movement.set_uniform("should_rain", should_rain);
-    prog.particle->movement.bind_texture("heightmap", data.heightmap.get_read_tex());
-    prog.particle->movement.bind_texture("momentmap", data.velocity.get_read_tex());
-    run_particles(prog.particle->movement, data.particle_count);
-
-    prog.particle->erosion.use();
-    prog.particle->erosion.bind_image("lockmap", data.lockmap);
-    prog.particle->erosion.bind_image("heightmap", data.heightmap.get_read_tex());
-    prog.particle->erosion.bind_image("momentmap", data.velocity.get_read_tex());
-    run_particles(prog.particle->erosion, data.particle_count);
-
-    run_thermal_erosion(prog, data);
-
-    prog.thermal.smooth.use();
-    prog.thermal.smooth.bind_image("heightmap", data.heightmap.get_read_tex());
-    prog.thermal.smooth.bind_image("momentmap", data.velocity.get_read_tex());
-    prog.thermal.smooth.bind_image("out_heightmap", data.heightmap.get_write_tex());
-    prog.thermal.smooth.bind_image("out_momentmap", data.velocity.get_write_tex());
-    run(prog.thermal.smooth, data.map_size);
-    data.heightmap.swap(true);
-    data.velocity.swap(true);
+    particle_step(prog, data, should_rain);
+    glMemoryBarrier(READER_BARRIERS);
 }
 
 void Erosion::dispatch_grid(Programs& prog, State::World::Textures& data) {
-    prog.grid->flux.use();
-    prog.grid->flux.bind_texture("heightmap", data.heightmap.get_read_tex());
-    prog.grid->flux.bind_texture("fluxmap", data.flux.get_read_tex());
-    prog.grid->flux.bind_texture("velocitymap", data.velocity.get_read_tex());
-    prog.grid->flux.bind_image("out_heightmap", data.heightmap.get_write_tex());
-    prog.grid->flux.bind_image("out_fluxmap", data.flux.get_write_tex());
-    prog.grid->flux.bind_image("out_velocitymap", data.velocity.get_write_tex());
-    run(prog.grid->flux, data.map_size);
-    data.heightmap.swap();
-    data.flux.swap();
-    data.velocity.swap();
-
-    prog.grid->erosion.use();
-    prog.grid->erosion.bind_image("heightmap", data.heightmap.get_read_tex());
-    prog.grid->erosion.bind_image("sedimap", data.sediment.get_read_tex());
-    prog.grid->erosion.bind_image("velocitymap", data.velocity.get_read_tex());
-    prog.grid->erosion.bind_image("out_heightmap", data.heightmap.get_write_tex());
-    prog.grid->erosion.bind_image("out_sedimap", data.sediment.get_write_tex());
-    run(prog.grid->erosion, data.map_size);
-    data.heightmap.swap();
-    data.sediment.swap();
-
-    prog.grid->sediment.use();
-    prog.grid->sediment.bind_texture("heightmap", data.heightmap.get_read_tex());
-    prog.grid->sediment.bind_texture("velocitymap", data.velocity.get_read_tex());
-    prog.grid->sediment.bind_texture("sedimap", data.sediment.get_read_tex());
-    prog.grid->sediment.bind_image("out_heightmap", data.heightmap.get_write_tex());
-    prog.grid->sediment.bind_image("out_sedimap", data.sediment.get_write_tex());
-    run(prog.grid->sediment, data.map_size);
-    data.heightmap.swap();
-    data.sediment.swap();
-
-    run_thermal_erosion(prog, data);
-
-    prog.thermal.smooth.use();
-    prog.thermal.smooth.bind_image("heightmap", data.heightmap.get_read_tex());
-    prog.thermal.smooth.bind_image("out_heightmap", data.heightmap.get_write_tex());
-    prog.thermal.smooth.unbind_image("momentmap");
-    prog.thermal.smooth.unbind_image("out_momentmap");
-    run(prog.thermal.smooth, data.map_size);
-    data.heightmap.swap();
+    grid_step(prog, data);
+    glMemoryBarrier(READER_BARRIERS);
+}
+
+void Erosion::dispatch_multigrid(Programs& prog, State::World::Textures& data) {
+    dispatch(prog.grid->multigrid_passes);
+    glMemoryBarrier(READER_BARRIERS);
 }
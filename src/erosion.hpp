@@ -2,13 +2,43 @@
 #ifndef HYDR_EROSION_HPP
 #define HYDR_EROSION_HPP
 
-#include "shaderprogram.hpp"
+#include "compute_pass.hpp"
 #include "state.hpp"
 namespace Erosion {
 
 struct Particle {
     Compute_program movement;
     Compute_program erosion;
+    // applies the deposits of the lock-free erosion, follows the deposition
+    // of the textures (State::World::Deposition)
+    Compute_program resolve;
+
+    // `substeps` steps of movement + erosion of every droplet in one dispatch
+    // when above 1, thermal erosion and smoothing run once per dispatch, atomic
+    // deposition runs the passes `substeps` times instead
+    Compute_program steps;
+    u32 substeps = 1;
+
+    // droplets sorted by map tile every `sort_period` steps, 0 never sorts,
+    // counting sort on the GPU, see particle_bins.glsl
+    Compute_program bin;
+    Compute_program scan;
+    Compute_program scatter;
+    u32 sort_period = 0;
+
+    // while it doesn't rain the droplet passes are dispatched indirectly over
+    // a list of the droplets still moving, rebuilt every step, see particle_live.glsl
+    Compute_program compact;
+    bool compact_live = false;
+    // set by every step
+    bool use_live_list = false;
+
+    // movement + erosion (+ resolve), built by setup_shaders
+    Vec<Compute_pass> passes;
+    Vec<Compute_pass> substep_passes;
+    Vec<Compute_pass> sort_passes;
+    Vec<Compute_pass> compact_passes;
+    bool should_rain = true;
 };
 
 struct Grid {
@@ -16,12 +46,63 @@ struct Grid {
     Compute_program erosion;
     Compute_program sediment;
     Compute_program rain;
+    // rain looks up one of the noise patterns evaluated by `rain_pattern`
+    // instead of the noise, the patterns follow the drops of `rain_data`
+    Compute_program rain_pattern;
+    bool cached_rain = false;
+    const Rain_data* rain_data;
+    // flux + erosion in one dispatch, replaces the two passes when fused is set
+    Compute_program step;
+    bool fused = true;
+
+    // adaptive time step: d_t follows the fastest wave on the map, recomputed
+    // every `adaptive_period` steps on the GPU, 0 keeps the d_t of the settings
+    Compute_program cfl_reduce;
+    Compute_program cfl_step;
+    u32 adaptive_period = 0;
+    // a push of the erosion settings overwrites d_t, the next step recomputes
+    // it early when `erosion_version` moved past the last update
+    const u32* erosion_version;
+    u32 adaptive_version = ~0u;
+    // steps the new d_t is counted for and the steps of the old one it replaces
+    u32 adaptive_steps = 0;
+    u32 adaptive_refund = 0;
+
+    // fused kernel and sediment transport only run on the tiles near water,
+    // dispatched indirectly from a tile list built on the GPU every step, see
+    // tiles.glsl, needs the fused kernel
+    Compute_program tile_list;
+    bool sparse = false;
+
+    // multigrid water solver: every `multigrid_period` steps the water is
+    // restricted down a pyramid of coarser levels, relaxed there and the
+    // change prolonged back onto the heightmap, so it crosses the map in a
+    // few cycles instead of a cell per step, 0 never runs it, see water_levels.glsl
+    Compute_program water_restrict;
+    Compute_program water_outflow;
+    Compute_program water_update;
+    Compute_program water_prolong;
+    u32 multigrid_period = 0;
+
+    // hydraulic part of a step with either kernel, built by setup_shaders
+    Vec<Compute_pass> fused_passes;
+    Vec<Compute_pass> split_passes;
+    Vec<Compute_pass> rain_passes;
+    Vec<Compute_pass> rain_pattern_passes;
+    Vec<Compute_pass> adaptive_passes;
+    Vec<Compute_pass> tile_passes;
+    Vec<Compute_pass> multigrid_passes;
 };
 
+// flux and transport handle all sediment layers in one dispatch each
 struct Thermal {
-    Compute_program flux[SED_LAYERS];
-    Compute_program transport[SED_LAYERS];
+    Compute_program flux;
+    Compute_program transport;
     Compute_program smooth;
+
+    // flux + transport, smoothing, built by setup_shaders
+    Vec<Compute_pass> passes;
+    Vec<Compute_pass> smooth_passes;
 };
 
 struct Programs {
@@ -30,11 +111,17 @@ struct Programs {
         PARTICLES
     } type;
 
-    Particle*   particle;
-    Grid*       grid;
-    Thermal     thermal;
+    // only the one of the erosion type is set
+    Uq_ptr<Particle>    particle;
+    Uq_ptr<Grid>        grid;
+    Thermal             thermal;
+    // the kernels are compiled for this map size, see State::World::kernel_defines,
+    // a map of another size needs new programs
+    u32                 map_size = 0;
 };
 
+// the dispatches keep pointers into `data`, it has to outlive the programs and
+// be the textures passed to every dispatch below
 Programs* setup_shaders(
     Programs::Erosion_type type, 
     State::Settings& set, 
@@ -42,9 +129,36 @@ Programs* setup_shaders(
     u32 particle_count
 );
 
+// consecutive erosion steps recorded back to back
+struct Steps {
+    // number of the first step counted from 1, grid rain falls on multiples of the period
+    u32 first;
+    u32 count;
+    u32 rain_period;
+    bool should_rain = true;
+    // data.time is the time of the first step and advances by this much every step
+    float time_step = 1.f / 60.f;
+};
+
+// `count` grid or particle steps with no CPU round trips in between, passes only
+// wait on the barriers their own reads need, one barrier at the end for whatever
+// reads the textures next (rendering, readbacks), the swaps of the texture pairs
+// are followed by every pass so any count leaves the pairs in a valid state,
+// the adaptive time step of the grid is updated and the droplets are sorted on
+// the steps after multiples of their periods, the multigrid water cycle runs
+// after the grid steps on multiples of its own
+void step(Programs& prog, State::World::Textures& data, const Steps& steps);
+
+// single dispatches, each ends with the barrier for the next reader
 void dispatch_grid_rain(Programs& prog, State::World::Textures& data);
 void dispatch_grid(Programs& prog, State::World::Textures& data);
+// a multigrid water cycle alone, already part of the grid steps on multiples of its period
+void dispatch_multigrid(Programs& prog, State::World::Textures& data);
 void dispatch_particle(Programs& prog, State::World::Textures& data, bool should_rain);
+// droplet sort alone, already part of the particle steps after multiples of its period
+void sort_particles(Programs& prog, State::World::Textures& data);
+// thermal erosion alone, already part of the grid and particle steps
+void dispatch_thermal(Programs& prog, State::World::Textures& data);
 
 };
 #endif // HYDR_EROSION_HPP
@@ -15,8 +15,8 @@
 #include "utils.hpp"
 #include "erosion.hpp"
 #include "state.hpp"
-
-constexpr auto noise_comput_file  = "heightmap.glsl";
+#include "batch.hpp"
+#include "profiler.hpp"
 
 // mouse position
 static glm::vec2 mouse_last;
@@ -178,8 +178,72 @@ void key_callback(GLFWwindow *window,
 }
 };
 
+// the command line overrides, config.ini and the defaults, in that order
+static Batch::Config resolve_config(const Batch::Options& opts, const INIReader& ini) {
+    Batch::Config config;
+    config.map_size = opts.map_size.value_or(ini.GetUnsigned("map", "size", 1024));
+
+    const std::string type = ini.Get("erosion", "type", "grid");
+    config.type = opts.type.value_or(
+        type == "particle" ? Erosion::Programs::PARTICLES : Erosion::Programs::GRID
+    );
+    if (config.type == Erosion::Programs::PARTICLES) {
+        config.particle_count = opts.particle_count.value_or(
+            ini.GetUnsigned("erosion", "particle_count", 262144)
+        );
+    }
+
+    config.fused_grid = opts.fused_grid.value_or(
+        ini.Get("erosion", "grid_kernel", "fused") != "split"
+    );
+
+    config.precision = opts.precision.value_or(
+        ini.Get("erosion", "precision", "full") == "reduced" ?
+            State::World::REDUCED : State::World::FULL
+    );
+
+    config.adaptive_period = opts.adaptive_period.value_or(
+        ini.GetUnsigned("erosion", "adaptive_step", 0)
+    );
+
+    config.sparse_grid = opts.sparse_grid.value_or(
+        ini.GetBoolean("erosion", "sparse", false)
+    );
+
+    config.multigrid_period = opts.multigrid_period.value_or(
+        ini.GetUnsigned("erosion", "multigrid", 0)
+    );
+
+    config.cached_rain = opts.cached_rain.value_or(
+        ini.Get("erosion", "rain", "noise") == "cached"
+    );
+
+    config.deposition = opts.deposition.value_or(
+        ini.Get("erosion", "deposition", "lock") == "atomic" ?
+            State::World::ATOMIC : State::World::LOCKED
+    );
+
+    config.sort_period = opts.sort_period.value_or(
+        ini.GetUnsigned("erosion", "particle_sort", 0)
+    );
+
+    config.substeps = std::max<u32>(1, opts.substeps.value_or(
+        ini.GetUnsigned("erosion", "particle_substeps", 1)
+    ));
+
+    config.compact_particles = opts.compact_particles.value_or(
+        ini.GetBoolean("erosion", "compact_particles", false)
+    );
+    return config;
+}
+
 int main(int argc, char* argv[]) { 
     srand(time(NULL));
+    const auto batch_opts = Batch::parse_args(argc, argv);
+    if (!batch_opts) {
+        Batch::print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
     // load config...
     auto cwd = std::filesystem::current_path().string();
 #ifdef __linux__
@@ -212,25 +276,37 @@ int main(int argc, char* argv[]) {
             "; type = grid or type = particle\n"\
             "type = grid\n"\
             "; particle_count works only when the erosion type is \"particle\"\n"\
-            "particle_count = 262144";
+            "particle_count = 262144\n"\
+            "; grid_kernel = fused (flux + erosion in one pass) or grid_kernel = split\n"\
+            "grid_kernel = fused\n"\
+            "; precision = full or precision = reduced (half float flux, velocity, sediment)\n"\
+            "precision = full\n"\
+            "; adaptive_step = N recomputes a CFL time step every N grid steps, 0 = fixed\n"\
+            "adaptive_step = 0\n"\
+            "; sparse = true runs the fused grid kernel only on the tiles near water\n"\
+            "sparse = false\n"\
+            "; multigrid = N redistributes the grid water over coarser levels every N steps, 0 = never\n"\
+            "multigrid = 0\n"\
+            "; rain = noise (evaluated per rain event) or rain = cached (looked up in precomputed patterns)\n"\
+            "rain = noise\n"\
+            "; deposition = lock (texel spinlocks) or deposition = atomic (fixed point deltas)\n"\
+            "deposition = lock\n"\
+            "; particle_sort = N sorts the droplets by map tile every N steps, 0 = never\n"\
+            "particle_sort = 0\n"\
+            "; particle_substeps = N moves every droplet N steps per dispatch of particle erosion\n"\
+            "particle_substeps = 1\n"\
+            "; compact_particles = true dispatches droplets only over the ones still moving when dry\n"\
+            "compact_particles = false";
         write_to_ini(cwd, config);
         ini_config = INIReader(cwd);    
     }
     const u32 WINDOW_W = ini_config.GetUnsigned("window", "width", 1280);
     const u32 WINDOW_H = ini_config.GetUnsigned("window", "height", 720);
 
-    const u32 MAP_SIZE = ini_config.GetUnsigned("map", "size", 1024);
+    const auto config = resolve_config(*batch_opts, ini_config);
 
-    Erosion::Programs::Erosion_type erosion_type;
-
-    const std::string erosion_type_str = ini_config.Get("erosion", "type", "grid");
-    u32 particle_count = 0;
-    
-    if (erosion_type_str == "particle") {
-        erosion_type = Erosion::Programs::PARTICLES;
-        particle_count = ini_config.GetUnsigned("erosion", "particle_count", 262144);
-    } else {
-        erosion_type = Erosion::Programs::GRID;
+    if (batch_opts->headless) {
+        return Batch::run(*batch_opts, config);
     }
 
     // GLFW Window
@@ -250,43 +326,60 @@ int main(int argc, char* argv[]) {
     // map gen + erosion settings from the UI
     // Sending uniform data to GPU
     auto settings = State::setup_settings(
-        erosion_type == Erosion::Programs::PARTICLES,
-        particle_count
+        config.type == Erosion::Programs::PARTICLES,
+        config.particle_count
     );
     defer{ State::delete_settings(settings); };
+    if (batch_opts->seed) {
+        settings.map.data.seed = *batch_opts->seed;
+    }
 
     // TODO: MOVE THIS OUT OF MAIN.CPP
     // Heightmap Generation Shader 
-    Compute_program comput_map(noise_comput_file);
+    State::World::Map_generator comput_map(State::World::shader_defines(config.precision));
     // -------------
 
     // Ingame World Data (world state textures)
     State::World::Textures world_data = 
-        State::World::gen_textures(MAP_SIZE, particle_count);
+        State::World::gen_textures(
+            config.map_size, config.particle_count, config.precision, config.deposition
+        );
     defer{delete_textures(world_data);};
 
     State::World::gen_heightmap(settings, world_data, comput_map);
     Uq_ptr<Erosion::Programs> erosion_progs_ptr(
         Erosion::setup_shaders(
-            erosion_type, 
+            config.type, 
             settings, 
             world_data, 
-            particle_count
+            config.particle_count
         )
     );
-    auto& erosion_progs = *erosion_progs_ptr.get();
+    if (erosion_progs_ptr->grid != nullptr) {
+        erosion_progs_ptr->grid->fused = config.fused_grid;
+    }
+    state.adaptive_period = config.adaptive_period;
+    state.sparse_grid = config.sparse_grid && config.fused_grid;
+    state.multigrid_period = config.multigrid_period;
+    state.cached_rain = config.cached_rain;
+    state.sort_period = config.sort_period;
+    state.particle_substeps = config.substeps;
+    state.compact_particles = config.compact_particles;
+
+    defer { Profiler::destroy(); };
 
     // ---------- prepare textures and framebuffer for rendering  ---------------
     auto renderer = Render::Data(
             WINDOW_W,
             WINDOW_H,
-            MAP_SIZE,
+            config.map_size,
             settings,
             state,
             world_data);
 
     while (!glfwWindowShouldClose(window.get()) && (!state.shader_error)) {
         glfwPollEvents();
+        renderer.poll_world(settings, state, world_data);
         world_data.time = glfwGetTime();
         if (
             (world_data.time - state.last_frame + state.erosion_mean_t) >= (1 / state.target_fps) &&
@@ -308,29 +401,41 @@ int main(int argc, char* argv[]) {
 
         // ---------- erosion compute shader ------------
         if (state.should_erode) {
-
-            state.erosion_steps++;
-            float erosion_d_time = glfwGetTime();
-            if (erosion_type == Erosion::Programs::GRID) {
-                if (state.should_rain) {
-                    if (!(state.erosion_steps % settings.rain.data.period)) {
-                        Erosion::dispatch_grid_rain(erosion_progs, world_data);
-                    }
+            // the kernels are compiled for one map size, a map generated at
+            // another size needs its own variants
+            if (erosion_progs_ptr->map_size != world_data.map_size) {
+                erosion_progs_ptr.reset(Erosion::setup_shaders(
+                    config.type,
+                    settings,
+                    world_data,
+                    config.particle_count
+                ));
+                if (erosion_progs_ptr->grid != nullptr) {
+                    erosion_progs_ptr->grid->fused = config.fused_grid;
                 }
-                Erosion::dispatch_grid(erosion_progs, world_data);
-            } 
-            else if (erosion_type == Erosion::Programs::PARTICLES) {
-                Erosion::dispatch_particle(erosion_progs, world_data, state.should_rain);
             }
-
-            erosion_d_time = glfwGetTime() - erosion_d_time;
-            state.erosion_time += erosion_d_time;
-            // calculate average erosion update time
-            if (!(state.erosion_steps % 100)) {
-                state.erosion_mean_t = state.erosion_time / 100.f;
-                state.erosion_time = 0;
+            auto& erosion_progs = *erosion_progs_ptr.get();
+            if (erosion_progs.grid != nullptr) {
+                erosion_progs.grid->adaptive_period = state.adaptive_period;
+                erosion_progs.grid->sparse = state.sparse_grid && erosion_progs.grid->fused;
+                erosion_progs.grid->multigrid_period = state.multigrid_period;
+                erosion_progs.grid->cached_rain = state.cached_rain;
+            }
+            if (erosion_progs.particle != nullptr) {
+                erosion_progs.particle->sort_period = state.sort_period;
+                erosion_progs.particle->substeps = state.particle_substeps;
+                erosion_progs.particle->compact_live = state.compact_particles;
             }
+            Erosion::step(erosion_progs, world_data, {
+                .first          = state.erosion_steps + 1,
+                .count          = u32(state.steps_per_frame),
+                .rain_period    = u32(settings.rain.data.period),
+                .should_rain    = state.should_rain
+            });
+            state.erosion_steps += state.steps_per_frame;
         }
+        Profiler::collect();
+        state.erosion_mean_t = state.steps_per_frame * Profiler::erosion_step_ms() / 1000.f;
         renderer.blit();
         renderer.handle_ui(
             settings,
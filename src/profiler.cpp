@@ -0,0 +1,173 @@
+#include "profiler.hpp"
+
+namespace {
+struct Timer {
+    GLuint queries[Profiler::QUERY_RING];
+    // ring of queries issued and not read back yet
+    u32 head = 0;
+    u32 pending = 0;
+    bool active = false;
+
+    float samples[Profiler::SAMPLE_WINDOW];
+    u32 sample_idx = 0;
+    u32 sample_count = 0;
+};
+
+bool initialised = false;
+Timer timers[Profiler::PASS_COUNT];
+
+void init() {
+    for (auto& timer : timers) {
+        glGenQueries(Profiler::QUERY_RING, timer.queries);
+    }
+    initialised = true;
+}
+};
+
+const char* Profiler::pass_name(u32 pass) {
+    switch (pass) {
+        case FLUX:              return "Water flux";
+        case EROSION:           return "Erosion";
+        case SEDIMENT:          return "Sediment transport";
+        case GRID_STEP:         return "Flux + erosion (fused)";
+        case RAIN:              return "Rain";
+        case RAIN_PATTERN:      return "Rain patterns";
+        case THERMAL_FLUX:      return "Thermal flux";
+        case THERMAL_TRANSPORT: return "Thermal transport";
+        case SMOOTH:            return "Smoothing";
+        case PARTICLE_MOVEMENT: return "Particle movement";
+        case PARTICLE_EROSION:  return "Particle erosion";
+        case PARTICLE_STEPS:    return "Particle sub-steps";
+        case DEPOSIT_RESOLVE:   return "Deposit resolve";
+        case PARTICLE_COMPACT:  return "Live droplet list";
+        case PARTICLE_BIN:      return "Particle binning";
+        case PARTICLE_SCAN:     return "Particle bin offsets";
+        case PARTICLE_SCATTER:  return "Particle reordering";
+        case CFL_REDUCE:        return "Max. wave speed";
+        case CFL_STEP:          return "Time step update";
+        case TILE_LIST:         return "Active tile list";
+        case WATER_RESTRICT:    return "Water restriction";
+        case WATER_OUTFLOW:     return "Water level outflow";
+        case WATER_UPDATE:      return "Water level update";
+        case WATER_PROLONG:     return "Water prolongation";
+        case RENDER:            return "Raymarching";
+        case HEIGHTMAP:         return "Heightmap generation";
+        case HEIGHTMAP_NOISE:   return "Heightmap noise";
+        default:                return "Unknown";
+    }
+}
+
+void Profiler::begin(u32 pass) {
+    if (!initialised) {
+        init();
+    }
+    auto& timer = timers[pass];
+    // all queries still in flight, drop this measurement instead of stalling
+    if (timer.pending == QUERY_RING) {
+        return;
+    }
+    glBeginQuery(GL_TIME_ELAPSED, timer.queries[timer.head]);
+    timer.active = true;
+}
+
+void Profiler::end(u32 pass) {
+    auto& timer = timers[pass];
+    if (!timer.active) {
+        return;
+    }
+    glEndQuery(GL_TIME_ELAPSED);
+    timer.active = false;
+    timer.head = (timer.head + 1) % QUERY_RING;
+    timer.pending++;
+}
+
+void Profiler::collect() {
+    if (!initialised) {
+        return;
+    }
+    for (auto& timer : timers) {
+        while (timer.pending > 0) {
+            const u32 tail = (timer.head + QUERY_RING - timer.pending) % QUERY_RING;
+            GLint available = 0;
+            glGetQueryObjectiv(timer.queries[tail], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                break;
+            }
+            GLuint64 elapsed_ns = 0;
+            glGetQueryObjectui64v(timer.queries[tail], GL_QUERY_RESULT, &elapsed_ns);
+            timer.pending--;
+
+            timer.samples[timer.sample_idx] = elapsed_ns / 1e6f;
+            timer.sample_idx = (timer.sample_idx + 1) % SAMPLE_WINDOW;
+            if (timer.sample_count < SAMPLE_WINDOW) {
+                timer.sample_count++;
+            }
+        }
+    }
+}
+
+void Profiler::reset() {
+    for (auto& timer : timers) {
+        timer.sample_idx = 0;
+        timer.sample_count = 0;
+    }
+}
+
+void Profiler::destroy() {
+    if (!initialised) {
+        return;
+    }
+    for (auto& timer : timers) {
+        glDeleteQueries(QUERY_RING, timer.queries);
+        timer = Timer{};
+    }
+    initialised = false;
+}
+
+float Profiler::mean_ms(u32 pass) {
+    const auto& timer = timers[pass];
+    if (timer.sample_count == 0) {
+        return 0.f;
+    }
+    float sum = 0.f;
+    for (u32 i = 0; i < timer.sample_count; i++) {
+        sum += timer.samples[i];
+    }
+    return sum / timer.sample_count;
+}
+
+u32 Profiler::sample_count(u32 pass) {
+    return timers[pass].sample_count;
+}
+
+float Profiler::erosion_step_ms() {
+    float sum = 0.f;
+    for (u32 pass = 0; pass < RENDER; pass++) {
+        // rain, the droplet sort and the multigrid water only run once per period
+        if (pass == RAIN || pass == RAIN_PATTERN
+            || (pass >= PARTICLE_BIN && pass <= PARTICLE_SCATTER)
+            || (pass >= WATER_RESTRICT && pass <= WATER_PROLONG)
+        ) {
+            continue;
+        }
+        sum += mean_ms(pass);
+    }
+    return sum;
+}
+
+bool Profiler::write_csv(const std::string& path) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        LOG_ERR("FAILED TO WRITE TO FILE: {}", path);
+        return false;
+    }
+    defer { fclose(file); };
+    fmt::print(file, "pass,mean_ms,samples\n");
+    for (u32 pass = 0; pass < PASS_COUNT; pass++) {
+        if (sample_count(pass) == 0) {
+            continue;
+        }
+        fmt::print(file, "\"{}\",{:.4f},{}\n", pass_name(pass), mean_ms(pass), sample_count(pass));
+    }
+    return true;
+}
@@ -0,0 +1,79 @@
+#ifndef HYDR_PROFILER_HPP
+#define HYDR_PROFILER_HPP
+
+#include <GL/glew.h>
+#include "utils.hpp"
+
+// GPU time of every compute pass, measured with GL_TIME_ELAPSED queries
+// results are polled a few frames later, nothing ever waits for the GPU
+namespace Profiler {
+
+enum Pass : u32 {
+    FLUX,
+    EROSION,
+    SEDIMENT,
+    // fused flux + erosion
+    GRID_STEP,
+    RAIN,
+    // noise of the cached rain, only when the drops change
+    RAIN_PATTERN,
+    THERMAL_FLUX,
+    THERMAL_TRANSPORT,
+    SMOOTH,
+    PARTICLE_MOVEMENT,
+    PARTICLE_EROSION,
+    // movement + erosion over several droplet steps in one dispatch
+    PARTICLE_STEPS,
+    // deposits of lock-free particle erosion applied to the map
+    DEPOSIT_RESOLVE,
+    // live droplets collected for the indirect dispatches
+    PARTICLE_COMPACT,
+    // droplet sort: counts per tile, offsets, reordering
+    PARTICLE_BIN,
+    PARTICLE_SCAN,
+    PARTICLE_SCATTER,
+    // adaptive time step, max. wave speed and the d_t update
+    CFL_REDUCE,
+    CFL_STEP,
+    // active tiles of sparse grid erosion
+    TILE_LIST,
+    // multigrid water: restriction, the two halves of a sweep, prolongation
+    WATER_RESTRICT,
+    WATER_OUTFLOW,
+    WATER_UPDATE,
+    WATER_PROLONG,
+    RENDER,
+    HEIGHTMAP,
+    // the noise terms of the heightmap, only when their settings change
+    HEIGHTMAP_NOISE,
+    PASS_COUNT
+};
+
+// queries in flight per pass, a pass is skipped (not timed) when all are busy
+constexpr u32 QUERY_RING = 4;
+// samples in the rolling mean
+constexpr u32 SAMPLE_WINDOW = 64;
+
+const char* pass_name(u32 pass);
+
+// only one pass can be timed at a time, passes don't nest
+void begin(u32 pass);
+void end(u32 pass);
+
+// fetch results of finished queries
+void collect();
+// drop all samples, e.g. between benchmark configurations
+void reset();
+void destroy();
+
+// rolling mean of the GPU time in milliseconds, 0 when there are no samples
+float mean_ms(u32 pass);
+u32 sample_count(u32 pass);
+// sum over the passes run every erosion step
+float erosion_step_ms();
+
+// "pass,mean_ms,samples" rows
+bool write_csv(const std::string& path);
+
+};
+#endif // HYDR_PROFILER_HPP
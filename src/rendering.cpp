@@ -1,4 +1,5 @@
 #include "rendering.hpp"
+#include "profiler.hpp"
 
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
@@ -9,6 +10,11 @@ constexpr auto render_comput_file = "rendering.glsl";
 Render::Data::~Data() {
     glDeleteFramebuffers(1, &framebuffer);
     gl::delete_texture(output_texture);
+    if (pending_world) {
+        glDeleteSync(pending_fence);
+        State::World::delete_textures(*pending_world);
+    }
+    gl::trim_pool();
     // LOG_DBG("Render data buffers deleted!");
 }
 
@@ -118,6 +124,7 @@ bool Render::Data::dispatch(
     glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
     glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 
+    Profiler::begin(Profiler::RENDER);
 #ifdef LOW_RES_DIV3
     glDispatchCompute(
         window_dims.w / (3 * WRKGRP_SIZE_X),
@@ -131,6 +138,7 @@ bool Render::Data::dispatch(
         1
     );
 #endif
+    Profiler::end(Profiler::RENDER);
     glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
     glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 
@@ -145,7 +153,7 @@ void heightmap_ui(
     State::Settings& set,
     State::Program_state& state,
     State::World::Textures& world,
-    Compute_program& map_generator
+    State::World::Map_generator& map_generator
 ) {
     auto& rain    = set.rain;
     auto& map     = set.map;
@@ -155,7 +163,32 @@ void heightmap_ui(
     ImGui::Checkbox("Display water", &rendr->display_water);
     ImGui::SliderFloat("Raymarching precision", &rendr->prec, 0.01f, 1.f);
     ImGui::SliderFloat("Target_fps", &state.target_fps, 2.f, 120.f);
-    ImGui::SliderFloat("Time step", &erosion.data.d_t, 0.0005f, 0.05f);
+    ImGui::SliderInt("Erosion steps per frame", &state.steps_per_frame, 1, 500, "%d", ImGuiSliderFlags_Logarithmic);
+    const bool is_grid = erosion.data.particle_count == 0;
+    // back to the fixed d_t of the slider
+    if (is_grid &&
+        ImGui::SliderInt("Adaptive time step period", &state.adaptive_period, 0, 100) &&
+        state.adaptive_period == 0
+    ) {
+        erosion.push_data();
+    }
+    if (is_grid) {
+        ImGui::Checkbox("Skip dry tiles", &state.sparse_grid);
+        ImGui::SliderInt("Multigrid water period", &state.multigrid_period, 0, 500, "%d", ImGuiSliderFlags_Logarithmic);
+        ImGui::Checkbox("Cached rain patterns", &state.cached_rain);
+    } else {
+        ImGui::SliderInt("Droplet sort period", &state.sort_period, 0, 1000, "%d", ImGuiSliderFlags_Logarithmic);
+        ImGui::SliderInt("Droplet steps per dispatch", &state.particle_substeps, 1, 64);
+        ImGui::Checkbox("Skip idle droplets", &state.compact_particles);
+    }
+    if (is_grid && state.adaptive_period > 0) {
+        ImGui::SliderFloat("Courant number", &erosion.data.courant, 0.01f, 1.f);
+        ImGui::SliderFloat("Max. time step", &erosion.data.d_t_max, 0.0005f, 0.05f);
+        ImGui::Text("Time step: {%.5f}", world.step->d_t);
+        ImGui::Text("Simulated time: {%.3f}", world.step->time);
+    } else {
+        ImGui::SliderFloat("Time step", &erosion.data.d_t, 0.0005f, 0.05f);
+    }
     ImGui::End();
 
     ImGui::Begin("Heightmap");
@@ -190,15 +223,21 @@ void heightmap_ui(
     ImGui::SliderInt("Terrace levels", &map.data.terrace, 0, 30);
     ImGui::SliderFloat("Terrace scale", &map.data.terrace_scale, 0.f, 1.f);
     
-    if (ImGui::Button("Generate")) {
-        bool old_erod = state.should_erode;
+    // the new world is filled behind the current one, see Render::Data::poll_world
+    if (rendr->pending_world) {
+        ImGui::Text("Generating...");
+    } else if (ImGui::Button("Generate")) {
+        rendr->resume_erosion = state.should_erode;
         state.should_erode = false;
-        u32 particle_count = world.particle_count;
-        delete_textures(world);
-        world = State::World::gen_textures(size, particle_count);
-        State::World::gen_heightmap(set, world, map_generator);
-        erosion.push_data();
-        state.should_erode = old_erod;
+        // the pooled storage of the previous world only fits the same size
+        if (GLuint(size) != world.map_size) {
+            gl::trim_pool();
+        }
+        rendr->pending_world = State::World::gen_textures(
+            size, world.particle_count, world.precision, world.deposition
+        );
+        State::World::gen_heightmap(set, *rendr->pending_world, map_generator);
+        rendr->pending_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
     }
 }
 
@@ -268,7 +307,7 @@ void Render::Data::handle_ui(
     State::Settings& set,
     State::Program_state& state,
     State::World::Textures& world,
-    Compute_program& map_generator
+    State::World::Map_generator& map_generator
 ) {
     auto& erosion = set.erosion;
     ImGui_ImplOpenGL3_NewFrame();
@@ -289,8 +328,16 @@ void Render::Data::handle_ui(
     ImGui::Text("Frame time (ms): {%.2f}", state.frame_t);
     ImGui::Text("FPS: {%.2f}", 1000.0 / state.frame_t);
     ImGui::Text("Total erosion updates: {%lu}", state.erosion_steps);
-    // ImGui::Text("Avg erosion time: {%f}", state.erosion_mean_t);
+    ImGui::Text("GPU erosion step (ms): {%.3f}", Profiler::erosion_step_ms());
     ImGui::Text("Total Time: {%f}", world.time);
+    if (ImGui::CollapsingHeader("GPU passes (ms)")) {
+        for (u32 pass = 0; pass < Profiler::PASS_COUNT; pass++) {
+            if (Profiler::sample_count(pass) == 0) {
+                continue;
+            }
+            ImGui::Text("%s: {%.3f}", Profiler::pass_name(pass), Profiler::mean_ms(pass));
+        }
+    }
     ImGui::End();
 
     ImGui::Begin("Settings");
@@ -329,6 +376,26 @@ heightmap_ui(
     ImGui::Render();
 }
 
+void Render::Data::poll_world(
+    State::Settings& set,
+    State::Program_state& state,
+    State::World::Textures& world
+) {
+    if (!pending_world) {
+        return;
+    }
+    if (glClientWaitSync(pending_fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+        return;
+    }
+    glDeleteSync(pending_fence);
+    pending_fence = nullptr;
+    State::World::recycle_textures(world);
+    world = *pending_world;
+    pending_world.reset();
+    set.erosion.push_data();
+    state.should_erode = resume_erosion;
+}
+
 void Render::Data::blit() {
     glBlitNamedFramebuffer(
         framebuffer, 0, 
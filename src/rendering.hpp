@@ -29,6 +29,13 @@ struct Data {
     float   aspect_ratio;
 
     Compute_program shader;
+
+    // a regenerated world waits here until the fence says the GPU has filled
+    // it, the old one keeps rendering meanwhile
+    Opt<State::World::Textures> pending_world;
+    GLsync pending_fence = nullptr;
+    bool resume_erosion = false;
+
     Data(
         GLuint window_width,
         GLuint window_height,
@@ -45,11 +52,17 @@ struct Data {
         State::Settings& settings,
         State::Program_state::Camera& camera
     );
+    // swaps in the pending world once it's ready, the old one is recycled
+    void poll_world(
+        State::Settings& settings,
+        State::Program_state& state,
+        State::World::Textures& world
+    );
     void handle_ui(
         State::Settings& settings,
         State::Program_state& state,
         State::World::Textures& world,
-        Compute_program& map_generator
+        State::World::Map_generator& map_generator
     );
 };
 
@@ -61,8 +61,12 @@ struct Map_settings {
 struct Erosion_settings {
     gl::Buffer buffer;
     Erosion_data data;
+    // counts the pushes, the adaptive time step is written into the buffer on
+    // the GPU and has to be recomputed after every one of them
+    u32 version = 0;
     void push_data() {
         buffer.push_data(data);
+        version++;
     }
 };
 
@@ -15,10 +15,35 @@ std::string load_shader_file(std::string filename);
 void resolve_includes(std::string& buff);
 
 namespace gl {
+    struct Pooled_texture {
+        GLenum target;
+        GLenum format;
+        GLuint width;
+        GLuint height;
+        GLuint texture;
+    };
+    struct Pooled_buffer {
+        GLint mode;
+        GLint64 size;
+        GLuint bo;
+    };
+    static Vec<Pooled_texture> texture_pool;
+    static Vec<Pooled_buffer> buffer_pool;
+
     void gen_texture(Texture& tex,
             GLenum format,
             GLenum type,
             const void* pixels) {
+        for (auto it = texture_pool.begin(); it != texture_pool.end(); it++) {
+            if (it->target == tex.target && it->format == tex.format &&
+                it->width == tex.width && it->height == tex.height
+            ) {
+                tex.texture = it->texture;
+                texture_pool.erase(it);
+                glClearTexImage(tex.texture, 0, format, type, nullptr);
+                return;
+            }
+        }
         glGenTextures(1, &tex.texture);
         glBindTexture(tex.target, tex.texture);
         glTexStorage2D(tex.target, 1, tex.format, (GLsizei)tex.width, (GLsizei)tex.height);
@@ -34,6 +59,15 @@ namespace gl {
         glBindBuffer(buff.type, 0);
     }
     void gen_buffer(Buffer& buff, size_t size) {
+        for (auto it = buffer_pool.begin(); it != buffer_pool.end(); it++) {
+            if (it->mode == buff.mode && it->size == GLint64(size)) {
+                buff.bo = it->bo;
+                buffer_pool.erase(it);
+                glBindBufferBase(buff.type, buff.binding, buff.bo);
+                glClearNamedBufferData(buff.bo, GL_R8UI, GL_RED_INTEGER, GL_UNSIGNED_BYTE, nullptr);
+                return;
+            }
+        }
         glGenBuffers(1, &buff.bo);
         glBindBuffer(buff.type, buff.bo);
         glBindBufferBase(buff.type, buff.binding, buff.bo);
@@ -44,10 +78,63 @@ namespace gl {
         );
         glBindBuffer(buff.type, 0);
     }
+    const void* gen_mapped_buffer(Buffer& buff, size_t size, const void* data) {
+        constexpr GLbitfield flags =
+            GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glCreateBuffers(1, &buff.bo);
+        glNamedBufferStorage(buff.bo, size, data, flags);
+        glBindBufferBase(buff.type, buff.binding, buff.bo);
+        return glMapNamedBufferRange(buff.bo, 0, size, flags);
+    }
     void del_buffer(Buffer& buff) {
         glDeleteBuffers(1, &buff.bo);
     }
 
+    void recycle_texture(Texture& tex) {
+        if (tex.texture == 0) {
+            return;
+        }
+        texture_pool.push_back({
+            .target = tex.target,
+            .format = tex.format,
+            .width = tex.width,
+            .height = tex.height,
+            .texture = tex.texture
+        });
+        tex.texture = 0;
+    }
+    void recycle_buffer(Buffer& buff) {
+        if (buff.bo == 0) {
+            return;
+        }
+        // mapped immutable storage can't be handed out by gen_buffer
+        GLint immutable;
+        glGetNamedBufferParameteriv(buff.bo, GL_BUFFER_IMMUTABLE_STORAGE, &immutable);
+        if (immutable) {
+            del_buffer(buff);
+            buff.bo = 0;
+            return;
+        }
+        GLint64 size;
+        glGetNamedBufferParameteri64v(buff.bo, GL_BUFFER_SIZE, &size);
+        buffer_pool.push_back({
+            .mode = buff.mode,
+            .size = size,
+            .bo = buff.bo
+        });
+        buff.bo = 0;
+    }
+    void trim_pool() {
+        for (auto& tex : texture_pool) {
+            glDeleteTextures(1, &tex.texture);
+        }
+        for (auto& buff : buffer_pool) {
+            glDeleteBuffers(1, &buff.bo);
+        }
+        texture_pool.clear();
+        buffer_pool.clear();
+    }
+
     void Tex_pair::swap(bool read_write) {
         cntr++;
         idx_read = cntr % 2;
@@ -81,14 +168,16 @@ namespace gl {
         return tex[idx_read];
     }
 
-    Tex_pair::Tex_pair(GLenum access, GLuint width, GLuint height) {
+    Tex_pair::Tex_pair(GLenum access, GLuint width, GLuint height, GLenum format) {
         this->tex[0] = gl::Texture {
             .access = access,
+            .format = format,
             .width = width,
             .height = height
         };
         this->tex[1] = gl::Texture {
             .access = access,
+            .format = format,
             .width = width,
             .height = height
         };
@@ -119,7 +208,13 @@ enum Log_type {
     PROGRAM
 };
 
+// resolved sources by file name, an include is read from disk once
+static std::unordered_map<std::string, std::string> source_cache;
+
 std::string load_shader_file(std::string filename) {
+    if (auto it = source_cache.find(filename); it != source_cache.end()) {
+        return it->second;
+    }
     std::string path;
     auto cwd = std::filesystem::current_path().string();
 #ifdef __linux__
@@ -159,6 +254,7 @@ std::string load_shader_file(std::string filename) {
     }
     resolve_includes(buffer);
 
+    source_cache[filename] = buffer;
     return buffer;
 }
 
@@ -205,20 +301,141 @@ void resolve_includes(std::string& buff) {
     }
 }
 
+static std::string preprocess_shader(std::string filename, std::string custom_defines) {
+    auto source_str = load_shader_file(filename);
+    // defines have to follow the #version directive
+    size_t defines_at = 0;
+    const size_t version = source_str.find("#version");
+    if (version != std::string::npos) {
+        defines_at = source_str.find('\n', version) + 1;
+    }
+    source_str.insert(defines_at, custom_defines);
+    return source_str;
+}
+
+// linked programs by the hash of their preprocessed source and the driver,
+// identical programs link once per run and once per driver across runs, see
+// PROGRAM_CACHE_DIR
+struct Program_binary {
+    GLenum format;
+    std::string data;
+};
+static std::unordered_map<u64, Program_binary> binary_cache;
+
+// FNV-1a, stable across runs and builds unlike std::hash
+static u64 hash_bytes(const std::string& str, u64 hash = 0xcbf29ce484222325) {
+    for (const unsigned char c : str) {
+        hash = (hash ^ c) * 0x100000001b3;
+    }
+    return hash;
+}
+
+static u64 program_key(const std::string& source) {
+    std::string driver;
+    for (const GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION}) {
+        const auto* str = reinterpret_cast<const char*>(glGetString(name));
+        driver += str ? str : "";
+        driver += '\n';
+    }
+    return hash_bytes(source, hash_bytes(driver));
+}
+
+static std::filesystem::path binary_path(u64 key) {
+    return std::filesystem::current_path() / PROGRAM_CACHE_DIR / fmt::format("{:016x}.bin", key);
+}
+
+// drivers without a binary format always compile
+static bool program_binaries_supported() {
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+static bool load_program_binary(GLuint program, u64 key) {
+    if (!program_binaries_supported()) {
+        return false;
+    }
+    auto it = binary_cache.find(key);
+    if (it == binary_cache.end()) {
+        FILE* file = fopen(binary_path(key).string().c_str(), "rb");
+        if (!file) {
+            return false;
+        }
+        defer { fclose(file); };
+        Program_binary binary;
+        fseek(file, 0, SEEK_END);
+        const long size = ftell(file) - long(sizeof(GLenum));
+        fseek(file, 0, SEEK_SET);
+        if (size <= 0) {
+            return false;
+        }
+        binary.data.resize(size);
+        if (fread(&binary.format, sizeof(GLenum), 1, file) != 1 ||
+            fread(binary.data.data(), size, 1, file) != 1
+        ) {
+            return false;
+        }
+        it = binary_cache.emplace(key, std::move(binary)).first;
+    }
+    glProgramBinary(program, it->second.format, it->second.data.data(), GLsizei(it->second.data.size()));
+    GLint success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    // stale after a driver update the version string didn't show
+    if (!success) {
+        binary_cache.erase(it);
+        return false;
+    }
+    return true;
+}
+
+static void store_program_binary(GLuint program, u64 key) {
+    if (!program_binaries_supported()) {
+        return;
+    }
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+    Program_binary binary;
+    binary.data.resize(length);
+    glGetProgramBinary(program, length, nullptr, &binary.format, binary.data.data());
+
+    // the cache only saves time, failing to write it isn't an error
+    std::error_code err;
+    std::filesystem::create_directories(binary_path(key).parent_path(), err);
+    FILE* file = fopen(binary_path(key).string().c_str(), "wb");
+    if (file) {
+        defer { fclose(file); };
+        fwrite(&binary.format, sizeof(GLenum), 1, file);
+        fwrite(binary.data.data(), binary.data.size(), 1, file);
+    } else {
+        LOG_DBG("Couldn't write the program cache: {}", binary_path(key).string());
+    }
+    binary_cache[key] = std::move(binary);
+}
+
 GLuint Shader_core::load_shader(
     GLenum shader_type, 
     std::string filename,
     std::string custom_defines
 ) {
+    GLuint shader = compile_shader(shader_type, preprocess_shader(filename, custom_defines));
+    return check_shader(shader) ? shader : 0;
+}
+
+GLuint Shader_core::compile_shader(GLenum shader_type, const std::string& source_str) {
     // handle
     GLuint shader = glCreateShader(shader_type);
-    auto source_str = load_shader_file(filename);
-    source_str = custom_defines + source_str;
     const GLint len = source_str.length();
     const GLchar* shader_source = source_str.c_str();
     glShaderSource(shader, 1, &shader_source, &len);
     glCompileShader(shader);
+    return shader;
+}
 
+// waits for the compile
+bool Shader_core::check_shader(GLuint shader) {
     GLint success;
     glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
     if (!success) {
@@ -238,23 +455,34 @@ GLuint Shader_core::load_shader(
 
         // Cleanup the failed shader
         glDeleteShader(shader);
-        return 0; // Indicate failure
+        return false; // Indicate failure
     }
-    return shader;
+    return true;
 }
 
-Compute_program::Compute_program(std::string filename, std::string custom_defines) {
-    LOG_DBG("Loading compute shader: {}", filename);
-    compute = load_shader(GL_COMPUTE_SHADER, filename, custom_defines);
-
-    program = glCreateProgram();
-
-    glAttachShader(program, compute);
-    glLinkProgram(program);
-
+void Shader_core::finish_link() const {
+    if (!link_pending) {
+        return;
+    }
+    link_pending = false;
     GLint success;
     glGetProgramiv(program, GL_LINK_STATUS, &success);
     if (!success) {
+        // the compile log says more than the link one
+        GLuint shaders[2];
+        GLsizei count = 0;
+        glGetAttachedShaders(program, 2, &count, shaders);
+        for (GLsizei i = 0; i < count; i++) {
+            GLint compiled;
+            glGetShaderiv(shaders[i], GL_COMPILE_STATUS, &compiled);
+            if (!compiled) {
+                GLint logLength;
+                glGetShaderiv(shaders[i], GL_INFO_LOG_LENGTH, &logLength);
+                std::string infoLog(logLength, ' ');
+                glGetShaderInfoLog(shaders[i], logLength, nullptr, &infoLog[0]);
+                LOG_ERR("Shader compilation failed: {}", infoLog);
+            }
+        }
         char infoLog[512];
         glGetProgramInfoLog(program, 512, nullptr, infoLog);
         LOG_ERR("ERROR (LINKING): {}", infoLog);
@@ -265,9 +493,31 @@ Compute_program::Compute_program(std::string filename, std::string custom_define
 #endif
     } else {
         LOG_DBG("Compute shader program created");
+        store_program_binary(program, binary_key);
     }
 }
 
+Compute_program::Compute_program(std::string filename, std::string custom_defines) {
+    LOG_DBG("Loading compute shader: {}", filename);
+    const auto source = preprocess_shader(filename, custom_defines);
+    const u64 key = program_key(source);
+
+    program = glCreateProgram();
+    if (load_program_binary(program, key)) {
+        compute = 0;
+        return;
+    }
+    // nothing waits on the compile and the link here, programs created back to
+    // back build in parallel on the driver threads, see init_gl
+    compute = compile_shader(GL_COMPUTE_SHADER, source);
+
+    glAttachShader(program, compute);
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(program);
+    link_pending = true;
+    binary_key = key;
+}
+
 Shader_program::Shader_program(std::string vert_file, std::string frag_file, std::string custom_defines) {
     LOG_DBG("Loading vertex shader...");
     vertex = load_shader(GL_VERTEX_SHADER, vert_file, custom_defines);
@@ -296,17 +546,22 @@ Shader_program::~Shader_program() {
 }
 
 Compute_program::~Compute_program() {
-    glDetachShader(program, compute);
-    glDeleteShader(compute);
+    // programs loaded from a binary have no shader
+    if (compute) {
+        glDetachShader(program, compute);
+        glDeleteShader(compute);
+    }
     glDeleteProgram(program);
     LOG_DBG("Compute shader program deleted");
 }
 
 void Shader_core::use() const {
+    finish_link();
     glUseProgram(program);
 }
 
 void Compute_program::bind_uniform_block(const char* variable, gl::Buffer &buff) const  {
+    finish_link();
     GLuint idx = glGetUniformBlockIndex(program, variable);
     if (idx == GL_INVALID_INDEX) {
         LOG_ERR("ERROR: Invalid buffer block index");
@@ -319,11 +574,21 @@ void Compute_program::bind_uniform_block(const char* variable, gl::Buffer &buff)
     glUniformBlockBinding(program, idx, buff.binding);
 }
 
+GLuint Compute_program::binding_unit(const char* var_name) {
+    GLuint location = get_uniform_location(std::string(var_name));
+    GLint bind;
+    glGetUniformiv(this->program, location, &bind);
+    return bind;
+}
+
+GLint Compute_program::uniform_location(const char* var_name) {
+    return get_uniform_location(std::string(var_name));
+}
+
 void Compute_program::bind_image(const char* var_name, const gl::Texture &tex) {
     GLuint location = get_uniform_location(std::string(var_name));
     GLint bind;    
     glGetUniformiv(this->program, location, &bind);
-    glBindTexture(tex.target, tex.texture);
     glBindImageTexture(
         bind, 
         tex.texture, 
@@ -358,6 +623,7 @@ void Compute_program::unbind_texture(const char* var_name) {
 }
 
 void Compute_program::bind_storage_buffer(const char* variable, gl::Buffer &buff) const {
+    finish_link();
     GLuint idx = glGetProgramResourceIndex(program, GL_SHADER_STORAGE_BLOCK, variable);
     if (idx == GL_INVALID_INDEX) {
         LOG_ERR("ERROR: Invalid shader storage buffer index");
@@ -375,6 +641,7 @@ void Compute_program::bind_storage_buffer(const char* variable, gl::Buffer &buff
 } */
 
 void Compute_program::listActiveUniforms() {
+    finish_link();
     GLint numUniforms = 0;
     glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &numUniforms);
     LOG_DBG("Number of active uniforms: {}", numUniforms);
@@ -395,6 +662,7 @@ void Compute_program::listActiveUniforms() {
 
 
 GLuint Shader_core::get_uniform_location(std::string name) {
+    finish_link();
     auto count = cached_bindings.count(name);
     if (count < 1) {
         GLuint location = glGetUniformLocation(this->program, name.c_str());
@@ -51,8 +51,18 @@ struct Buffer {
 };
 void gen_buffer(Buffer& buff);
 void gen_buffer(Buffer& buff, size_t size);
+// immutable storage initialised with `data`, mapped coherently for reading
+// until the buffer is deleted, the GPU writes show up without a readback
+const void* gen_mapped_buffer(Buffer& buff, size_t size, const void* data);
 void del_buffer(Buffer& buff);
 
+// storage handed to the pool instead of being deleted, the next gen_texture or
+// gen_buffer of the same format and size takes it back zeroed, without a new
+// allocation, trim_pool deletes whatever is left in it
+void recycle_texture(Texture& tex);
+void recycle_buffer(Buffer& buff);
+void trim_pool();
+
 // TODO: Refactor
 // texture pairs for swapping
 struct Tex_pair {
@@ -62,7 +72,7 @@ struct Tex_pair {
 
     u32 cntr = 0;
     void swap(bool read_write = false);
-    Tex_pair(GLenum access, GLuint width, GLuint height);
+    Tex_pair(GLenum access, GLuint width, GLuint height, GLenum format = GL_RGBA32F);
     const gl::Texture& get_write_tex() const;
     const gl::Texture& get_read_tex() const;
 
@@ -76,8 +86,20 @@ class Shader_core {
 protected:
     GLuint program;
     GLuint load_shader(GLenum shader_type, std::string filename, std::string custom_defines);
+    // submits the compile without waiting for it, see check_shader
+    GLuint compile_shader(GLenum shader_type, const std::string& source);
+    bool check_shader(GLuint shader);
     std::unordered_map<std::string, GLuint> cached_bindings;
 
+    // a program is linked in the background, the first use waits for it,
+    // reports the errors and stores the binary under `binary_key`. Nothing
+    // polls GL_COMPLETION_STATUS: the erosion setup binds and resolves every
+    // program right after submitting them all, there is no frame to skip
+    // until a program is done
+    mutable bool link_pending = false;
+    u64 binary_key = 0;
+    void finish_link() const;
+
     // GLuint get_attrib_location(const char* attribute) const;
     GLuint get_uniform_location(std::string uniform);
 public:
@@ -96,6 +118,10 @@ public:
     ~Shader_program();
 };
 
+// linked compute programs are cached here, relative to the working directory
+// like glsl/, delete it to force a rebuild
+constexpr auto PROGRAM_CACHE_DIR = "shader_cache";
+
 class Compute_program : public Shader_core {
 private:
     GLuint compute;
@@ -111,6 +137,10 @@ public:
 
     void bind_storage_buffer(const char* variable, gl::Buffer &buff) const;
 
+    // texture/image unit of a sampler or image uniform, see Compute_pass
+    GLuint binding_unit(const char* var_name);
+    GLint uniform_location(const char* var_name);
+
     Compute_program(std::string comput_files, std::string custom_defines = "");
     ~Compute_program();
 };
@@ -1,61 +1,326 @@
 #include "state.hpp"
+#include "profiler.hpp"
+
+State::World::Field_formats State::World::field_formats(Precision precision) {
+    if (precision == REDUCED) {
+        return {
+            .flux       = GL_RGBA16F,
+            .velocity   = GL_RGBA16F,
+            .sediment   = GL_RG16F,
+            .thermal    = GL_RGBA16F
+        };
+    }
+    return {
+        .flux       = GL_RGBA32F,
+        .velocity   = GL_RGBA32F,
+        .sediment   = GL_RGBA32F,
+        .thermal    = GL_RGBA32F
+    };
+}
+
+std::string State::World::shader_defines(Precision precision) {
+    if (precision == REDUCED) {
+        return
+            "#define FLUX_FORMAT rgba16f\n"
+            "#define VEL_FORMAT rgba16f\n"
+            "#define SED_FORMAT rg16f\n"
+            "#define THFLUX_FORMAT rgba16f\n";
+    }
+    return "";
+}
+
+std::string State::World::kernel_defines(const Textures& data) {
+    auto defines = shader_defines(data.precision) +
+        fmt::format("#define MAP_SIZE {}u\n", data.map_size);
+    if (data.particle_count) {
+        defines += "#define PARTICLE_EROSION\n";
+    }
+    return defines;
+}
+
+// bytes per texel of the internal formats used for the fields
+static size_t format_bytes(GLenum format) {
+    switch (format) {
+        case GL_R16F:       return sizeof(GLhalf);
+        case GL_RG16F:      return 2 * sizeof(GLhalf);
+        case GL_RGBA16F:    return 4 * sizeof(GLhalf);
+        default:            return 4 * sizeof(GLfloat);
+    }
+}
+
+// a bin per tile and one for the droplets waiting to spawn, as in particle_bins.glsl
+static size_t particle_bin_count(GLuint size) {
+    return size_t(size / WRKGRP_SIZE_X) * (size / WRKGRP_SIZE_Y) + 1;
+}
+
+static size_t kill_mask_words(u32 particle_count) {
+    return (size_t(particle_count) + 31) / 32;
+}
+
+size_t State::World::particle_stream_bytes(u32 particle_count) {
+    return size_t(particle_count) * (
+            sizeof(Particle_motion) + sizeof(Particle_state) + SED_LAYERS * sizeof(GLfloat)
+        ) +
+        kill_mask_words(particle_count) * sizeof(GLuint);
+}
+
+static void gen_particle_streams(State::World::Particle_streams& streams, u32 particle_count) {
+    gl::gen_buffer(streams.motion, particle_count * sizeof(Particle_motion));
+    gl::gen_buffer(streams.state, particle_count * sizeof(Particle_state));
+    gl::gen_buffer(streams.sediment, particle_count * SED_LAYERS * sizeof(GLfloat));
+    gl::gen_buffer(streams.kill, kill_mask_words(particle_count) * sizeof(GLuint));
+    glClearNamedBufferData(streams.kill.bo, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+}
+
 
 State::World::Textures State::World::gen_textures(
     const GLuint size,
-    const GLuint particle_count
+    const GLuint particle_count,
+    Precision precision,
+    Deposition deposition
 ) {
+    const auto formats = field_formats(precision);
     gl::Texture lockmap {
         .access = GL_READ_WRITE,
         .format = GL_R32UI,
         .width = size,
         .height = size
     };
-    gl::gen_texture(lockmap, GL_RED_INTEGER, GL_UNSIGNED_INT);
+    if (particle_count && deposition == LOCKED) {
+        gl::gen_texture(lockmap, GL_RED_INTEGER, GL_UNSIGNED_INT);
+    }
     gl::Tex_pair heightmap(GL_READ_WRITE, size, size);
-    gl::Tex_pair flux(GL_READ_WRITE, size, size);
-    gl::Tex_pair velocity(GL_READ_WRITE, size, size);
-    gl::Tex_pair sediment(GL_READ_WRITE, size, size);
+    gl::Tex_pair flux(GL_READ_WRITE, size, size, formats.flux);
+    gl::Tex_pair sediment(GL_READ_WRITE, size, size, formats.sediment);
+    gl::Texture velocity {
+        .access = GL_READ_WRITE,
+        .format = formats.velocity,
+        .width = size,
+        .height = size
+    };
+    gl::gen_texture(velocity);
 
-    // ------------- cross    flux for thermal erosion -----------
-    gl::Tex_pair thermal_c(GL_READ_WRITE, size, size);
-    // ------------- diagonal flux for thermal erosion -----------
-    gl::Tex_pair thermal_d(GL_READ_WRITE, size, size);
 
-    gl::Buffer particle_buffer {
-        .binding = BIND_PARTICLE_BUFFER,
+    Particle_streams particles {
+        .motion = {.binding = BIND_PARTICLE_MOTION, .type = GL_SHADER_STORAGE_BUFFER},
+        .state = {.binding = BIND_PARTICLE_STATE, .type = GL_SHADER_STORAGE_BUFFER},
+        .sediment = {.binding = BIND_PARTICLE_SEDIMENT, .type = GL_SHADER_STORAGE_BUFFER},
+        .kill = {.binding = BIND_PARTICLE_KILL, .type = GL_SHADER_STORAGE_BUFFER}
+    };
+    Particle_streams particle_scratch {
+        .motion = {.binding = BIND_SCRATCH_MOTION, .type = GL_SHADER_STORAGE_BUFFER},
+        .state = {.binding = BIND_SCRATCH_STATE, .type = GL_SHADER_STORAGE_BUFFER},
+        .sediment = {.binding = BIND_SCRATCH_SEDIMENT, .type = GL_SHADER_STORAGE_BUFFER},
+        .kill = {.binding = BIND_SCRATCH_KILL, .type = GL_SHADER_STORAGE_BUFFER}
+    };
+    gl::Buffer particle_bins {
+        .binding = BIND_PARTICLE_BINS,
+        .type = GL_SHADER_STORAGE_BUFFER
+    };
+    gl::Buffer particle_live {
+        .binding = BIND_PARTICLE_LIVE,
         .type = GL_SHADER_STORAGE_BUFFER
     };
     if (particle_count) {
-        gl::gen_buffer(particle_buffer, particle_count * sizeof(Particle));
+        gen_particle_streams(particles, particle_count);
+        gl::gen_buffer(particle_live, (4 + particle_count) * sizeof(GLuint));
+        gen_particle_streams(particle_scratch, particle_count);
+        gl::gen_buffer(particle_bins, particle_bin_count(size) * sizeof(GLuint));
     }
 
-    return State::World::Textures {
+    gl::Buffer step_buffer {
+        .binding = BIND_STEP_BUFFER,
+        .type = GL_SHADER_STORAGE_BUFFER
+    };
+    const Step_data initial_step {};
+    const void* step = gl::gen_mapped_buffer(step_buffer, sizeof(Step_data), &initial_step);
+
+    // every tile starts out live, the first step dispatches the whole map
+    const GLuint tile_count = (size / WRKGRP_SIZE_X) * (size / WRKGRP_SIZE_Y);
+    gl::Buffer tile_state {
+        .binding = BIND_TILE_STATE,
+        .type = GL_SHADER_STORAGE_BUFFER
+    };
+    gl::gen_buffer(tile_state, tile_count * sizeof(GLuint));
+    glClearNamedBufferData(tile_state.bo, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    gl::Buffer tile_list {
+        .binding = BIND_TILE_LIST,
+        .type = GL_SHADER_STORAGE_BUFFER
+    };
+    gl::gen_buffer(tile_list, (4 + tile_count) * sizeof(GLuint));
+    const GLuint dispatch_args[4] = {0, 1, 1, 0};
+    glNamedBufferSubData(tile_list.bo, 0, sizeof(dispatch_args), dispatch_args);
+
+    State::World::Textures data {
         .map_size = size,
         .particle_count = particle_count,
+        .precision = precision,
+        .deposition = deposition,
         .heightmap = heightmap,
         .flux = flux,
-        .velocity = velocity,
         .sediment = sediment,
-        .thermal_c = thermal_c,
-        .thermal_d = thermal_d,
+        .velocity = velocity,
         .lockmap = lockmap,
-        .particle_buffer = particle_buffer
+        .particles = particles,
+        .particle_scratch = particle_scratch,
+        .particle_bins = particle_bins,
+        .particle_live = particle_live,
+        .step_buffer = step_buffer,
+        .step = static_cast<const Step_data*>(step),
+        .tile_state = tile_state,
+        .tile_list = tile_list
     };
+    // cross and diagonal flux for thermal erosion, written and read within a step
+    for (u32 i = 0; i < SED_LAYERS; i++) {
+        for (auto* tex : {&data.thermal_c[i], &data.thermal_d[i]}) {
+            *tex = gl::Texture {
+                .access = GL_READ_WRITE,
+                .format = formats.thermal,
+                .width = size,
+                .height = size
+            };
+            gl::gen_texture(*tex);
+        }
+    }
+    // grid erosion only, halved while the level stays a multiple of the workgroup
+    GLuint level_size = particle_count ? 0 : size;
+    for (u32 i = 0; i < WATER_LEVELS; i++) {
+        level_size = level_size % (2 * WRKGRP_SIZE_X) ? 0 : level_size / 2;
+        data.water_level_sizes[i] = level_size;
+        data.water_levels[i] = gl::Texture {
+            .access = GL_READ_WRITE,
+            .width = level_size,
+            .height = level_size
+        };
+        if (level_size) {
+            gl::gen_texture(data.water_levels[i]);
+        }
+    }
+    data.water_outflow = data.water_levels[0];
+    if (data.water_level_sizes[0]) {
+        gl::gen_texture(data.water_outflow);
+    }
+    for (auto& tex : data.rain_patterns) {
+        tex = gl::Texture {
+            .access = GL_READ_WRITE,
+            .format = GL_R16F,
+            .width = size,
+            .height = size
+        };
+        if (!particle_count) {
+            gl::gen_texture(tex);
+        }
+    }
+    // zeroed here, then by deposit_resolve.glsl after every step
+    for (auto& tex : data.deposits) {
+        tex = gl::Texture {
+            .access = GL_READ_WRITE,
+            .format = GL_R32I,
+            .width = size,
+            .height = size
+        };
+        if (particle_count && deposition == ATOMIC) {
+            gl::gen_texture(tex, GL_RED_INTEGER, GL_INT);
+            glClearTexImage(tex.texture, 0, GL_RED_INTEGER, GL_INT, nullptr);
+        }
+    }
+    return data;
 };
 
+size_t State::World::texture_bytes(
+    const GLuint size,
+    const GLuint particle_count,
+    Precision precision,
+    Deposition deposition
+) {
+    const auto formats = field_formats(precision);
+    const size_t texels = size_t(size) * size;
+    // 3 texture pairs, velocity, 2 thermal textures per layer
+    size_t texel_bytes = 2 * (
+            format_bytes(GL_RGBA32F) +
+            format_bytes(formats.flux) +
+            format_bytes(formats.sediment)
+        ) +
+        format_bytes(formats.velocity) +
+        2 * SED_LAYERS * format_bytes(formats.thermal);
+    // r32ui lockmap or r32i deposits
+    if (particle_count) {
+        texel_bytes += deposition == ATOMIC ? DEPOSIT_LAYERS * sizeof(GLint) : sizeof(GLuint);
+    }
+    // the water pyramid of grid erosion, a third of the map + the outflow of
+    // its first level
+    if (!particle_count) {
+        texel_bytes += format_bytes(GL_RGBA32F) * 7 / 12;
+    }
+    // the rain patterns of grid erosion
+    if (!particle_count) {
+        texel_bytes += RAIN_PATTERNS * format_bytes(GL_R16F);
+    }
+    // the particles, their sorting copy and bins, the live list
+    const size_t particle_bytes = particle_count ?
+        2 * particle_stream_bytes(particle_count) +
+        (particle_bin_count(size) + 4 + particle_count) * sizeof(GLuint) : 0;
+    return texels * texel_bytes + particle_bytes;
+}
+
+// deletes the storage or hands it to the pool of gl::gen_texture/gen_buffer
+static void release_textures(State::World::Textures& data, bool recycle) {
+    const auto texture = [recycle](gl::Texture& tex) {
+        if (recycle) {
+            gl::recycle_texture(tex);
+        } else {
+            gl::delete_texture(tex);
+        }
+    };
+    const auto buffer = [recycle](gl::Buffer& buff) {
+        if (recycle) {
+            gl::recycle_buffer(buff);
+        } else {
+            gl::del_buffer(buff);
+        }
+    };
+    for (auto* pair : {&data.heightmap, &data.flux, &data.sediment}) {
+        texture(pair->tex[0]);
+        texture(pair->tex[1]);
+    }
+    texture(data.velocity);
+    for (u32 i = 0; i < SED_LAYERS; i++) {
+        texture(data.thermal_c[i]);
+        texture(data.thermal_d[i]);
+    }
+    for (auto* streams : {&data.particles, &data.particle_scratch}) {
+        buffer(streams->motion);
+        buffer(streams->state);
+        buffer(streams->sediment);
+        buffer(streams->kill);
+    }
+    buffer(data.particle_bins);
+    buffer(data.particle_live);
+    buffer(data.step_buffer);
+    buffer(data.tile_state);
+    buffer(data.tile_list);
+    texture(data.lockmap);
+    for (auto& tex : data.deposits) {
+        texture(tex);
+    }
+    for (auto& tex : data.water_levels) {
+        texture(tex);
+    }
+    for (auto& tex : data.rain_patterns) {
+        texture(tex);
+    }
+    texture(data.water_outflow);
+}
+
 void State::World::delete_textures(State::World::Textures& data) {
-    data.heightmap.delete_textures();
-    data.velocity.delete_textures();
-    data.flux.delete_textures();
-    data.sediment.delete_textures();
-    data.thermal_c.delete_textures();
-    data.thermal_d.delete_textures();
-    gl::del_buffer(data.particle_buffer);
-    gl::delete_texture(data.lockmap);
+    release_textures(data, false);
 }
 
-State::Settings State::setup_settings(bool is_particle, u32 particle_count) {
-    LOG_DBG("Generating settings buffers...");
+void State::World::recycle_textures(State::World::Textures& data) {
+    release_textures(data, true);
+}
+
+State::Settings State::default_settings(bool is_particle, u32 particle_count) {
     Settings set;
     if (is_particle) {
         set.erosion.data = {
@@ -89,11 +354,20 @@ State::Settings State::setup_settings(bool is_particle, u32 particle_count) {
             .Kspeed         = VEC2(0.5f, 2.0f),
             .G              = 1.0,
             .d_t            = 0.001,
+            .courant        = 0.25,
+            .d_t_min        = 0.0005,
+            .d_t_max        = 0.01,
         };
     }
     set.rain.buffer.binding     = BIND_UNIFORM_RAIN_SETTINGS;
     set.erosion.buffer.binding  = BIND_UNIFORM_EROSION;
     set.map.buffer.binding      = BIND_UNIFORM_MAP_SETTINGS;
+    return set;
+}
+
+State::Settings State::setup_settings(bool is_particle, u32 particle_count) {
+    LOG_DBG("Generating settings buffers...");
+    Settings set = default_settings(is_particle, particle_count);
 
     gl::gen_buffer(set.rain.buffer);
     gl::gen_buffer(set.erosion.buffer);
@@ -113,28 +387,90 @@ void State::delete_settings(State::Settings& set) {
 }
 
 
-void State::World::gen_heightmap(
-    Settings& settings,
+State::World::Map_generator::Map_generator(std::string custom_defines) :
+    shape(heightmap_comput_file, custom_defines),
+    noise_program(heightmap_noise_file, custom_defines)
+{}
+
+State::World::Map_generator::~Map_generator() {
+    if (noise.width) {
+        gl::delete_texture(noise);
+    }
+}
+
+// the fields of Map_settings_data read by heightmap_noise.glsl
+static bool same_noise(const Map_settings_data& a, const Map_settings_data& b) {
+    return a.seed == b.seed
+        && a.persistance == b.persistance
+        && a.lacunarity == b.lacunarity
+        && a.scale == b.scale
+        && a.octaves == b.octaves
+        && a.uplift == b.uplift
+        && (!a.uplift || a.uplift_scale == b.uplift_scale)
+        && a.domain_warp == b.domain_warp
+        // offsets the terrain noise by (1, 1) times the scale without the warp too
+        && a.domain_warp_scale == b.domain_warp_scale;
+}
+
+static void gen_noise(
+    State::Settings& settings,
     State::World::Textures& world,
-    Compute_program& program
+    State::World::Map_generator& gen
 ) {
+    if (gen.noise.width != world.map_size) {
+        if (gen.noise.width) {
+            gl::delete_texture(gen.noise);
+        }
+        gen.noise.width = world.map_size;
+        gen.noise.height = world.map_size;
+        gl::gen_texture(gen.noise);
+        gen.noise_settings.reset();
+    }
+    if (gen.noise_settings && same_noise(*gen.noise_settings, settings.map.data)) {
+        return;
+    }
+    auto& program = gen.noise_program;
     program.use();
+    program.bind_uniform_block("map_settings", settings.map.buffer);
+    program.bind_image("dest_noise", gen.noise);
 
+    glMemoryBarrier(GL_ALL_BARRIER_BITS);
+    Profiler::begin(Profiler::HEIGHTMAP_NOISE);
+    glDispatchCompute(world.map_size / WRKGRP_SIZE_X, world.map_size / WRKGRP_SIZE_Y, 1);
+    Profiler::end(Profiler::HEIGHTMAP_NOISE);
+    glMemoryBarrier(GL_ALL_BARRIER_BITS);
+
+    program.unbind_image("dest_noise");
+    gen.noise_settings = settings.map.data;
+}
+
+void State::World::gen_heightmap(
+    Settings& settings,
+    State::World::Textures& world,
+    Map_generator& generator
+) {
     settings.map.push_data();
+    gen_noise(settings, world, generator);
+
+    auto& program = generator.shape;
+    program.use();
     program.bind_uniform_block("map_settings", settings.map.buffer);
-    program.bind_storage_buffer("ParticleBuffer", world.particle_buffer);
+    program.bind_storage_buffer("ParticleState", world.particles.state);
+    glUniform1ui(program.uniform_location("particle_count"), world.particle_count);
 
     program.bind_image("dest_heightmap", world.heightmap.get_write_tex());
-    program.bind_image("dest_vel", world.velocity.get_write_tex());
+    program.bind_image("dest_vel", world.velocity);
     program.bind_image("dest_flux", world.flux.get_write_tex());
     program.bind_image("dest_sediment", world.sediment.get_write_tex());
+    program.bind_image("noise", generator.noise);
 
     glMemoryBarrier(GL_ALL_BARRIER_BITS);
+    Profiler::begin(Profiler::HEIGHTMAP);
     glDispatchCompute(world.map_size / WRKGRP_SIZE_X, world.map_size / WRKGRP_SIZE_Y, 1);
+    Profiler::end(Profiler::HEIGHTMAP);
     glMemoryBarrier(GL_ALL_BARRIER_BITS);
 
     world.heightmap.swap(true);
-    world.velocity.swap(true);
     world.flux.swap(true);
     world.sediment.swap(true);
 
@@ -142,6 +478,7 @@ void State::World::gen_heightmap(
     program.unbind_image("dest_vel");
     program.unbind_image("dest_flux");
     program.unbind_image("dest_sediment");
+    program.unbind_image("noise");
 
     glUseProgram(0);
 }
@@ -13,6 +13,8 @@ struct Settings {
     Map_settings map;
 };
 
+// plain values without the GL buffers, for the CPU engines
+Settings default_settings(bool is_particle = false, u32 particle_count = 0);
 Settings setup_settings(bool is_particle = false, u32 particle_count = 0);
 void delete_settings(Settings& settings);
 
@@ -33,7 +35,23 @@ struct Program_state {
     double frame_t = 0.0;
 
     u32 erosion_steps = 0;
-    float erosion_time;
+    // erosion steps dispatched in one batch per main loop iteration
+    i32 steps_per_frame = 1;
+    // grid steps between adaptive time step updates, 0 = fixed d_t
+    i32 adaptive_period = 0;
+    // fused grid kernel over the tiles near water only
+    bool sparse_grid = false;
+    // grid steps between multigrid water cycles, 0 = never
+    i32 multigrid_period = 0;
+    // grid rain looked up in cached noise patterns
+    bool cached_rain = false;
+    // particle steps between droplet sorts, 0 = never
+    i32 sort_period = 0;
+    // droplet steps per dispatch of particle erosion
+    i32 particle_substeps = 1;
+    // droplet passes over the live droplets only while it doesn't rain
+    bool compact_particles = false;
+    // GPU time of the erosion steps of an iteration in seconds, from the timer queries
     float erosion_mean_t = 0.f;
 
     float target_fps = 66.f;
@@ -56,32 +74,154 @@ struct Program_state {
 
 // all OpenGL textures representing world state
 namespace World {
+constexpr auto heightmap_comput_file = "heightmap.glsl";
+constexpr auto heightmap_noise_file  = "heightmap_noise.glsl";
+
+// storage of the flux, velocity, sediment and thermal fields, heights stay
+// 32-bit in both since the erosion amounts are tiny next to them
+enum Precision {
+    FULL,
+    // half floats, sediment in RG16F (SED_LAYERS channels)
+    REDUCED
+};
+
+// how droplets write their erosion into the heightmap
+enum Deposition {
+    // every texel of a droplet quad is updated under a spinlock on the lockmap
+    LOCKED,
+    // fixed point deltas summed with atomic adds, applied by a resolve pass over
+    // the map, no lockmap and no waiting on other droplets
+    ATOMIC
+};
+
+struct Field_formats {
+    GLenum flux;
+    GLenum velocity;
+    GLenum sediment;
+    GLenum thermal;
+};
+Field_formats field_formats(Precision precision);
+// custom defines for the shaders writing the fields, see bindings.glsl
+std::string shader_defines(Precision precision);
+
+// droplets of particle erosion, one buffer per stream so a kernel only moves
+// the fields it needs, see particle_streams.glsl
+struct Particle_streams {
+    // Particle_motion, Particle_state and the vec2 sediment of every droplet
+    gl::Buffer motion;
+    gl::Buffer state;
+    gl::Buffer sediment;
+    // a bit per droplet
+    gl::Buffer kill;
+};
+
+size_t particle_stream_bytes(u32 particle_count);
+
+// levels of the multigrid water pyramid below the heightmap, enough to go
+// from an 8192 map down to a single workgroup
+constexpr u32 WATER_LEVELS = 10;
+
 struct Textures {
     GLfloat time;
     u32 map_size;
     u32 particle_count;
+    Precision precision;
+    Deposition deposition;
     gl::Tex_pair heightmap;
 
-    // hydraulic erosion
+    // hydraulic erosion, flux and sediment are read around a cell (neighbours,
+    // back-traced position) so they keep two copies
     gl::Tex_pair flux;
-    gl::Tex_pair velocity;
     gl::Tex_pair sediment;
+    // only ever read and written at the own cell within a pass, updated in place,
+    // the momentmap of particle erosion
+    gl::Texture velocity;
 
-    // thermal erosion
-    gl::Tex_pair thermal_c;
-    gl::Tex_pair thermal_d;
+    // thermal erosion, cross and diagonal outflow of every layer
+    gl::Texture thermal_c[SED_LAYERS];
+    gl::Texture thermal_d[SED_LAYERS];
 
+    // particle erosion only, the lockmap with LOCKED deposition, the r32i
+    // deposits of DEPOSIT_LAYERS with ATOMIC
     gl::Texture lockmap;
-    gl::Buffer particle_buffer;
+    gl::Texture deposits[DEPOSIT_LAYERS];
+    Particle_streams particles;
+    // droplet sorting, the copy the sorted streams are scattered from and the
+    // droplet counts / first index of every tile, see particle_bins.glsl
+    Particle_streams particle_scratch;
+    gl::Buffer particle_bins;
+    // indirect dispatch arguments + ids of the droplets that aren't idle
+    gl::Buffer particle_live;
+
+    // adaptive time step of grid erosion, `step` maps the buffer, it lags a few
+    // steps behind the GPU and is only exact after a glFinish
+    gl::Buffer step_buffer;
+    const Step_data* step;
+
+    // sparse grid erosion over WRKGRP_SIZE_X x WRKGRP_SIZE_Y tiles, see tiles.glsl:
+    // quiet steps of every tile and the indirect dispatch arguments + tile list
+    gl::Buffer tile_state;
+    gl::Buffer tile_list;
+
+    // multigrid water solver of grid erosion, see water_levels.glsl: the size
+    // of every level (half of the one above, 0 past the coarsest), the levels
+    // and the outflow of a relaxation sweep of any of them
+    u32 water_level_sizes[WATER_LEVELS];
+    gl::Texture water_levels[WATER_LEVELS];
+    gl::Texture water_outflow;
+
+    // cached rain of grid erosion, see rain_pattern.glsl: the noise patterns
+    // and the drops setting they were evaluated with, negative before the first
+    gl::Texture rain_patterns[RAIN_PATTERNS];
+    float rain_pattern_drops = -1.f;
 };
 
-Textures gen_textures(const GLuint size, const GLuint particle_count);
+// shader_defines plus the constants the erosion kernels are compiled with: the
+// map size and PARTICLE_EROSION
+std::string kernel_defines(const Textures& data);
+
+Textures gen_textures(
+    const GLuint size,
+    const GLuint particle_count,
+    Precision precision = FULL,
+    Deposition deposition = LOCKED
+);
+// GPU memory taken by gen_textures
+size_t texture_bytes(
+    const GLuint size,
+    const GLuint particle_count,
+    Precision precision = FULL,
+    Deposition deposition = LOCKED
+);
 void delete_textures(Textures& data);
+// the storage goes to the pool of gl::gen_texture/gen_buffer for the next
+// gen_textures of the same size, the GPU must be done with `data`
+void recycle_textures(Textures& data);
+
+// heightmap generation, outlives the textures it fills: the noise terms of
+// heightmap_noise.glsl stay cached in `noise` across regenerations, changes
+// of the masks, terracing, height or dirt only rerun the shaping of heightmap.glsl
+struct Map_generator {
+    Compute_program shape;
+    Compute_program noise_program;
+    // rg32f, (terrain, dirt), generated on first use and for another map size
+    gl::Texture noise {
+        .access = GL_READ_WRITE,
+        .format = GL_RG32F,
+        .width = 0,
+        .height = 0
+    };
+    // the settings `noise` was evaluated with
+    Opt<Map_settings_data> noise_settings;
+
+    Map_generator(std::string custom_defines = "");
+    ~Map_generator();
+};
 
 void gen_heightmap(
     Settings& settings,
     State::World::Textures& world_data,
-    Compute_program& program
+    Map_generator& generator
 );
 
 };
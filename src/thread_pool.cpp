@@ -0,0 +1,84 @@
+#include "thread_pool.hpp"
+
+Thread_pool::Thread_pool(u32 threads) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    // the caller works too
+    for (u32 i = 1; i < threads; i++) {
+        workers.emplace_back([this]() { worker_loop(); });
+    }
+}
+
+Thread_pool::~Thread_pool() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+u32 Thread_pool::size() const {
+    return workers.size() + 1;
+}
+
+void Thread_pool::run_chunks() {
+    for (;;) {
+        const u32 begin = next_chunk.fetch_add(job_chunk);
+        if (begin >= job_count) {
+            return;
+        }
+        (*job)(begin, std::min(begin + job_chunk, job_count));
+    }
+}
+
+void Thread_pool::worker_loop() {
+    u64 seen = 0;
+    for (;;) {
+        {
+            std::unique_lock lock(mutex);
+            wake.wait(lock, [&]() { return stopping || generation != seen; });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+        }
+        run_chunks();
+        {
+            std::lock_guard lock(mutex);
+            busy_workers--;
+        }
+        finished.notify_one();
+    }
+}
+
+void Thread_pool::parallel_for(u32 count, u32 chunk, const std::function<void(u32, u32)>& fn) {
+    if (count == 0) {
+        return;
+    }
+    chunk = std::max<u32>(1, chunk);
+    if (workers.empty() || count <= chunk) {
+        for (u32 begin = 0; begin < count; begin += chunk) {
+            fn(begin, std::min(begin + chunk, count));
+        }
+        return;
+    }
+    {
+        std::lock_guard lock(mutex);
+        job = &fn;
+        job_count = count;
+        job_chunk = chunk;
+        next_chunk = 0;
+        busy_workers = workers.size();
+        generation++;
+    }
+    wake.notify_all();
+    run_chunks();
+
+    std::unique_lock lock(mutex);
+    finished.wait(lock, [&]() { return busy_workers == 0; });
+    job = nullptr;
+}
@@ -0,0 +1,45 @@
+#ifndef HYDR_THREAD_POOL_HPP
+#define HYDR_THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include "utils.hpp"
+
+// fixed set of worker threads for the CPU erosion engines
+struct Thread_pool {
+    // 0 = one thread per hardware thread
+    explicit Thread_pool(u32 threads = 0);
+    ~Thread_pool();
+
+    Thread_pool(const Thread_pool&) = delete;
+    Thread_pool& operator=(const Thread_pool&) = delete;
+
+    // threads taking part in a job, the calling thread included
+    u32 size() const;
+
+    // splits [0, count) into chunks and calls fn(begin, end) for each of them,
+    // chunks are handed out dynamically, returns when all of them are done
+    void parallel_for(u32 count, u32 chunk, const std::function<void(u32, u32)>& fn);
+
+private:
+    void worker_loop();
+    void run_chunks();
+
+    Vec<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+
+    const std::function<void(u32, u32)>* job = nullptr;
+    u32 job_count = 0;
+    u32 job_chunk = 1;
+    std::atomic<u32> next_chunk = 0;
+    u32 busy_workers = 0;
+    u64 generation = 0;
+    bool stopping = false;
+};
+
+#endif // HYDR_THREAD_POOL_HPP
@@ -10,6 +10,11 @@
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
 
+#ifdef HYDR_HEADLESS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
 void GLAPIENTRY gl_error_callback(
     GLenum source,
     GLenum type,
@@ -70,6 +75,8 @@ void GLAPIENTRY gl_error_callback(
     }
 }
 
+static bool init_gl(bool* error_bool);
+
 GLFWwindow* init_window(glm::uvec2 window_size, const char* window_title, bool* error_bool) {
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
@@ -88,21 +95,147 @@ GLFWwindow* init_window(glm::uvec2 window_size, const char* window_title, bool*
     // glfwSetInputMode(win, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
     glfwSwapInterval(0);
     glViewport(0, 0, window_size.x, window_size.y);
+    if (!init_gl(error_bool)) {
+        return nullptr;
+    }
+    return win;
+}
+
+// shared by the windowed and the headless context
+static bool init_gl(bool* error_bool) {
     glEnable(GL_ARB_uniform_buffer_object);
     glEnable(GL_EXT_shader_image_load_formatted);
 
-    if (glewInit() != GLEW_OK) {
+    GLenum glew_status = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+    // GLX-only GLEW builds complain about the missing X display on EGL contexts,
+    // the GL entry points are loaded regardless
+    if (glew_status == GLEW_ERROR_NO_GLX_DISPLAY) {
+        glew_status = GLEW_OK;
+    }
+#endif
+    if (glew_status != GLEW_OK) {
         LOG_ERR("Failed to initialise GLEW!");
-        return nullptr;
+        return false;
+    }
+    // compiles and links run on driver threads, a Compute_program only waits
+    // for its own program when it's first used
+    if (GLEW_KHR_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+    } else if (GLEW_ARB_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
     }
 #ifdef DEBUG
     glEnable(GL_DEBUG_OUTPUT);
     glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
     glDebugMessageCallback(gl_error_callback, error_bool);
 #endif
-    return win;
+    return true;
+}
+
+#ifdef HYDR_HEADLESS_EGL
+struct Headless_context {
+    EGLDisplay display;
+    EGLContext context;
+};
+
+Headless_context* init_headless(bool* error_bool) {
+    auto get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+        eglGetProcAddress("eglGetPlatformDisplayEXT");
+    EGLDisplay display = EGL_NO_DISPLAY;
+    // surfaceless platform doesn't need a display server (Mesa, llvmpipe included)
+    if (get_platform_display != nullptr) {
+        display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    }
+    if (display == EGL_NO_DISPLAY) {
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr)) {
+        LOG_ERR("Failed to initialise the EGL display.");
+        return nullptr;
+    }
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        LOG_ERR("EGL: OpenGL API is not available.");
+        eglTerminate(display);
+        return nullptr;
+    }
+    const EGLint ctx_attribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 6,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+#ifdef DEBUG
+        EGL_CONTEXT_OPENGL_DEBUG, EGL_TRUE,
+#endif
+        EGL_NONE
+    };
+    // no config and no surface, everything is rendered to textures anyway
+    EGLContext context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, ctx_attribs);
+    if (context == EGL_NO_CONTEXT) {
+        LOG_ERR("Failed to create an OpenGL 4.6 EGL context.");
+        eglTerminate(display);
+        return nullptr;
+    }
+    if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        LOG_ERR("Failed to make the EGL context current.");
+        eglDestroyContext(display, context);
+        eglTerminate(display);
+        return nullptr;
+    }
+    auto ctx = new Headless_context {
+        .display = display,
+        .context = context
+    };
+    if (!init_gl(error_bool)) {
+        destroy_headless(ctx);
+        return nullptr;
+    }
+    return ctx;
+}
+
+void destroy_headless(Headless_context* ctx) {
+    eglMakeCurrent(ctx->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(ctx->display, ctx->context);
+    eglTerminate(ctx->display);
+    delete ctx;
+}
+#else
+// no EGL, fall back to a hidden GLFW window
+struct Headless_context {
+    GLFWwindow* window;
+};
+
+Headless_context* init_headless(bool* error_bool) {
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+#ifdef DEBUG
+    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, true);  
+#endif
+    GLFWwindow* win = glfwCreateWindow(1, 1, "hydro-gen", NULL, NULL);
+    if (win == nullptr) {
+        LOG_ERR("Failed to create a hidden window.");
+        glfwTerminate();
+        return nullptr;
+    }
+    glfwMakeContextCurrent(win);
+    auto ctx = new Headless_context {
+        .window = win
+    };
+    if (!init_gl(error_bool)) {
+        destroy_headless(ctx);
+        return nullptr;
+    }
+    return ctx;
 }
 
+void destroy_headless(Headless_context* ctx) {
+    destroy_window(ctx->window);
+    delete ctx;
+}
+#endif
+
 void init_imgui(GLFWwindow* window) {
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
@@ -39,6 +39,11 @@ void init_imgui(GLFWwindow* window);
 void destroy_window(GLFWwindow* win);
 void destroy_imgui();
 
+// offscreen GL context without a window, used for batch runs
+struct Headless_context;
+Headless_context* init_headless(bool* error_bool);
+void destroy_headless(Headless_context* ctx);
+
 // defer
 #ifndef defer
 struct defer_dummy {};